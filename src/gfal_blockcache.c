@@ -0,0 +1,298 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * gfal_blockcache.c
+ * in memory cache of file blocks, LRU eviction bounded by cache_size
+ * */
+
+#include <string.h>
+
+#include "gfal_blockcache.h"
+#include "gfal_checksum.h"
+#include "params.h"
+
+typedef struct _gfalfs_block_key{
+	guint64 file_id;
+	guint64 index;
+} gfalfs_block_key;
+
+typedef struct _gfalfs_block{
+	gfalfs_block_key key;
+	char* data;
+	size_t len;
+	gboolean prefetched; // prefetched and not used yet
+	GList* lru_link; // NULL for the blocks of a pinned file, never evicted
+	GList* file_link; // link in the block list of the file signature
+} gfalfs_block;
+
+typedef struct _gfalfs_file_signature{
+	time_t mtime;
+	off_t size;
+	gboolean pinned;
+	guint blocks; // the signature goes with the last block of an unpinned file
+	guint64 bytes;
+	GList* block_list; // cached blocks of the file, an inserted block is counted before being listed
+	char checksum[GFALFS_CHECKSUM_MAX_LEN]; // verified checksum of the cached content, empty if not trusted
+} gfalfs_file_signature;
+
+static GStaticMutex blockcache_mutex = G_STATIC_MUTEX_INIT;
+static GHashTable* block_table = NULL;
+static GHashTable* signature_table = NULL;
+static GQueue lru = G_QUEUE_INIT; // most recently used first
+static guint64 cache_used = 0;
+static guint64 cache_pinned = 0;
+static guint64 stat_prefetched = 0;
+static guint64 stat_prefetch_hits = 0;
+
+
+static guint gfalfs_block_key_hash(gconstpointer k){
+	const gfalfs_block_key* key = (const gfalfs_block_key*) k;
+	const guint64 h = key->file_id ^ (key->index * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15));
+	return (guint) (h ^ (h >> 32));
+}
+
+static gboolean gfalfs_block_key_equal(gconstpointer a, gconstpointer b){
+	const gfalfs_block_key* ka = (const gfalfs_block_key*) a;
+	const gfalfs_block_key* kb = (const gfalfs_block_key*) b;
+	return ka->file_id == kb->file_id && ka->index == kb->index;
+}
+
+static void gfalfs_block_delete(gpointer data){
+	gfalfs_block* block = (gfalfs_block*) data;
+	gfalfs_file_signature* sig = g_hash_table_lookup(signature_table, &(block->key.file_id));
+	if(sig != NULL && block->file_link != NULL){
+		sig->block_list = g_list_delete_link(sig->block_list, block->file_link);
+		sig->bytes -= block->len;
+	}
+	if(sig != NULL && --(sig->blocks) == 0 && !sig->pinned)
+		g_hash_table_remove(signature_table, &(block->key.file_id));
+	if(block->lru_link != NULL)
+		g_queue_delete_link(&lru, block->lru_link);
+	else
+		cache_pinned -= block->len;
+	cache_used -= block->len;
+	g_free(block->data);
+	g_free(block);
+}
+
+static void gfalfs_blockcache_init(){
+	if(block_table == NULL){
+		block_table = g_hash_table_new_full(gfalfs_block_key_hash, gfalfs_block_key_equal, NULL, gfalfs_block_delete);
+		signature_table = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+	}
+}
+
+static void gfalfs_blockcache_drop_file_locked(guint64 file_id){
+	gfalfs_file_signature* sig;
+	// the removal of the last block can free the signature
+	while( (sig = g_hash_table_lookup(signature_table, &file_id)) != NULL && sig->block_list != NULL)
+		g_hash_table_remove(block_table, &(((gfalfs_block*) sig->block_list->data)->key));
+}
+
+static gfalfs_file_signature* gfalfs_blockcache_get_signature(guint64 file_id, gboolean* created){
+	gfalfs_file_signature* sig = g_hash_table_lookup(signature_table, &file_id);
+	*created = (sig == NULL);
+	if(sig == NULL){
+		guint64* key = g_new(guint64, 1);
+		*key = file_id;
+		sig = g_new0(gfalfs_file_signature, 1);
+		sig->size = -1;
+		g_hash_table_insert(signature_table, key, sig);
+	}
+	return sig;
+}
+
+void gfalfs_blockcache_set_file(guint64 file_id, time_t mtime, off_t size, const char* checksum){
+	gboolean created;
+	g_static_mutex_lock(&blockcache_mutex);
+	gfalfs_blockcache_init();
+	gfalfs_file_signature* sig = g_hash_table_lookup(signature_table, &file_id);
+	if(sig != NULL && (sig->mtime != mtime || sig->size != size)
+		&& checksum != NULL && *(sig->checksum) != '\0' && gfalfs_checksum_equal(sig->checksum, checksum)){
+		gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_blockcache blocks of file %lu revalidated by checksum", (unsigned long) file_id);
+	}else if(sig == NULL || sig->mtime != mtime || sig->size != size){
+		gfalfs_blockcache_drop_file_locked(file_id); // can remove the signature
+		sig = gfalfs_blockcache_get_signature(file_id, &created);
+		*(sig->checksum) = '\0';
+	}
+	sig->mtime = mtime;
+	sig->size = size;
+	g_static_mutex_unlock(&blockcache_mutex);
+}
+
+gboolean gfalfs_blockcache_file_unchanged(guint64 file_id, time_t mtime, off_t size){
+	g_static_mutex_lock(&blockcache_mutex);
+	gfalfs_file_signature* sig = (signature_table)?g_hash_table_lookup(signature_table, &file_id):NULL;
+	const gboolean res = (sig != NULL && sig->mtime == mtime && sig->size == size);
+	g_static_mutex_unlock(&blockcache_mutex);
+	return res;
+}
+
+void gfalfs_blockcache_set_trusted(guint64 file_id, const char* checksum){
+	g_static_mutex_lock(&blockcache_mutex);
+	gfalfs_file_signature* sig = (signature_table)?g_hash_table_lookup(signature_table, &file_id):NULL;
+	if(sig != NULL)
+		g_strlcpy(sig->checksum, (checksum)?checksum:"", GFALFS_CHECKSUM_MAX_LEN);
+	g_static_mutex_unlock(&blockcache_mutex);
+}
+
+gboolean gfalfs_blockcache_get_trusted(guint64 file_id, char* buff, size_t s_buff){
+	gboolean res = FALSE;
+	g_static_mutex_lock(&blockcache_mutex);
+	gfalfs_file_signature* sig = (signature_table)?g_hash_table_lookup(signature_table, &file_id):NULL;
+	if(sig != NULL && sig->blocks > 0 && *(sig->checksum) != '\0'){
+		g_strlcpy(buff, sig->checksum, s_buff);
+		res = TRUE;
+	}
+	g_static_mutex_unlock(&blockcache_mutex);
+	return res;
+}
+
+ssize_t gfalfs_blockcache_read(guint64 file_id, guint64 index, char* dst, size_t in_block, size_t len, gboolean* eof){
+	ssize_t res = -1;
+	gfalfs_block_key key = { file_id, index };
+	g_static_mutex_lock(&blockcache_mutex);
+	gfalfs_block* block = (block_table)?g_hash_table_lookup(block_table, &key):NULL;
+	if(block != NULL){
+		res = (in_block < block->len)?MIN(len, block->len - in_block):0;
+		memcpy(dst, block->data + in_block, res);
+		*eof = (block->len < gfalfs_get_block_size());
+		if(block->prefetched){
+			block->prefetched = FALSE;
+			++stat_prefetch_hits;
+		}
+		// move to the head of the lru list
+		if(block->lru_link != NULL){
+			g_queue_unlink(&lru, block->lru_link);
+			g_queue_push_head_link(&lru, block->lru_link);
+		}
+	}
+	g_static_mutex_unlock(&blockcache_mutex);
+	return res;
+}
+
+gboolean gfalfs_blockcache_contains(guint64 file_id, guint64 index){
+	gfalfs_block_key key = { file_id, index };
+	g_static_mutex_lock(&blockcache_mutex);
+	const gboolean res = (block_table != NULL && g_hash_table_lookup(block_table, &key) != NULL);
+	g_static_mutex_unlock(&blockcache_mutex);
+	return res;
+}
+
+void gfalfs_blockcache_insert(guint64 file_id, guint64 index, const char* data, size_t len, gboolean prefetched){
+	if(len > gfalfs_get_cache_size())
+		return;
+	gfalfs_block* block = g_new0(gfalfs_block, 1);
+	block->key.file_id = file_id;
+	block->key.index = index;
+	block->data = g_memdup(data, len);
+	block->len = len;
+	block->prefetched = prefetched;
+
+	gboolean created;
+	g_static_mutex_lock(&blockcache_mutex);
+	gfalfs_blockcache_init();
+	// counted first, the evictions below keep the signature
+	gfalfs_file_signature* sig = gfalfs_blockcache_get_signature(file_id, &created);
+	sig->blocks += 1;
+	g_hash_table_remove(block_table, &(block->key));
+	while(cache_used + len > gfalfs_get_cache_size() && !g_queue_is_empty(&lru)){
+		gfalfs_block* victim = (gfalfs_block*) g_queue_peek_tail(&lru);
+		g_hash_table_remove(block_table, &(victim->key));
+	}
+	if(cache_used + len > gfalfs_get_cache_size()){ // the cache is full of pinned blocks
+		if(--(sig->blocks) == 0 && !sig->pinned)
+			g_hash_table_remove(signature_table, &file_id);
+		g_static_mutex_unlock(&blockcache_mutex);
+		g_free(block->data);
+		g_free(block);
+		return;
+	}
+	if(sig->pinned){
+		cache_pinned += len;
+	}else{
+		g_queue_push_head(&lru, block);
+		block->lru_link = g_queue_peek_head_link(&lru);
+	}
+	g_hash_table_insert(block_table, &(block->key), block);
+	sig->block_list = g_list_prepend(sig->block_list, block);
+	block->file_link = sig->block_list;
+	sig->bytes += len;
+	cache_used += len;
+	if(prefetched)
+		++stat_prefetched;
+	g_static_mutex_unlock(&blockcache_mutex);
+}
+
+void gfalfs_blockcache_drop_file(guint64 file_id){
+	g_static_mutex_lock(&blockcache_mutex);
+	if(block_table != NULL)
+		gfalfs_blockcache_drop_file_locked(file_id);
+	g_static_mutex_unlock(&blockcache_mutex);
+}
+
+static void gfalfs_block_set_pinned(gpointer data, gpointer user_data){
+	gfalfs_block* block = (gfalfs_block*) data;
+	gfalfs_file_signature* sig = (gfalfs_file_signature*) user_data;
+	if((block->lru_link == NULL) == sig->pinned)
+		return;
+	if(sig->pinned){
+		g_queue_delete_link(&lru, block->lru_link);
+		block->lru_link = NULL;
+		cache_pinned += block->len;
+	}else{
+		g_queue_push_head(&lru, block);
+		block->lru_link = g_queue_peek_head_link(&lru);
+		cache_pinned -= block->len;
+	}
+}
+
+void gfalfs_blockcache_set_pinned(guint64 file_id, gboolean pinned){
+	gboolean created;
+	g_static_mutex_lock(&blockcache_mutex);
+	gfalfs_blockcache_init();
+	gfalfs_file_signature* sig = gfalfs_blockcache_get_signature(file_id, &created);
+	if(sig->pinned != pinned){
+		sig->pinned = pinned;
+		g_list_foreach(sig->block_list, gfalfs_block_set_pinned, sig);
+	}
+	if(!pinned && sig->blocks == 0)
+		g_hash_table_remove(signature_table, &file_id);
+	g_static_mutex_unlock(&blockcache_mutex);
+}
+
+void gfalfs_blockcache_get_file_usage(guint64 file_id, guint64* blocks, guint64* bytes, gboolean* pinned){
+	g_static_mutex_lock(&blockcache_mutex);
+	gfalfs_file_signature* sig = (signature_table)?g_hash_table_lookup(signature_table, &file_id):NULL;
+	*blocks = (sig != NULL)?sig->blocks:0;
+	*bytes = (sig != NULL)?sig->bytes:0;
+	*pinned = (sig != NULL && sig->pinned);
+	g_static_mutex_unlock(&blockcache_mutex);
+}
+
+void gfalfs_blockcache_get_usage(guint64* used, guint64* pinned){
+	g_static_mutex_lock(&blockcache_mutex);
+	*used = cache_used;
+	*pinned = cache_pinned;
+	g_static_mutex_unlock(&blockcache_mutex);
+}
+
+void gfalfs_blockcache_get_stats(guint64* prefetched, guint64* prefetch_hits){
+	g_static_mutex_lock(&blockcache_mutex);
+	*prefetched = stat_prefetched;
+	*prefetch_hits = stat_prefetch_hits;
+	g_static_mutex_unlock(&blockcache_mutex);
+}
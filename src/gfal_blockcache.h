@@ -0,0 +1,60 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_blockcache.h
+ * @brief in memory cache of file blocks shared by all the handles
+ */
+
+#include <sys/types.h>
+#include <glib.h>
+
+// declare the current signature of a file, drop its blocks if the content changed
+// checksum is the current storage checksum if known, it keeps the trusted blocks of a file whose attributes changed
+void gfalfs_blockcache_set_file(guint64 file_id, time_t mtime, off_t size, const char* checksum);
+
+// TRUE if the cached blocks of the file belong to this signature
+gboolean gfalfs_blockcache_file_unchanged(guint64 file_id, time_t mtime, off_t size);
+
+// mark the cached blocks of a file as verified with the given checksum, NULL to clear
+void gfalfs_blockcache_set_trusted(guint64 file_id, const char* checksum);
+
+// get the verified checksum of the cached blocks of a file, FALSE if they are not trusted
+gboolean gfalfs_blockcache_get_trusted(guint64 file_id, char* buff, size_t s_buff);
+
+// copy len bytes from offset in_block of a cached block, return the copied size or -1 if the block is not cached
+// eof is set to TRUE if the block is the last one of the file
+ssize_t gfalfs_blockcache_read(guint64 file_id, guint64 index, char* dst, size_t in_block, size_t len, gboolean* eof);
+
+// TRUE if a block is cached
+gboolean gfalfs_blockcache_contains(guint64 file_id, guint64 index);
+
+// insert a block, a block shorter than the block size is the last one of the file
+void gfalfs_blockcache_insert(guint64 file_id, guint64 index, const char* data, size_t len, gboolean prefetched);
+
+void gfalfs_blockcache_drop_file(guint64 file_id);
+
+// keep the blocks of a file out of the lru eviction
+void gfalfs_blockcache_set_pinned(guint64 file_id, gboolean pinned);
+
+// number and size of the cached blocks of a file
+void gfalfs_blockcache_get_file_usage(guint64 file_id, guint64* blocks, guint64* bytes, gboolean* pinned);
+
+// size of all the cached blocks, and of the pinned ones
+void gfalfs_blockcache_get_usage(guint64* used, guint64* pinned);
+
+// global counters of the prefetched blocks and of the prefetched blocks used later
+void gfalfs_blockcache_get_stats(guint64* prefetched, guint64* prefetch_hits);
@@ -0,0 +1,256 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+
+/*
+ * gfal_bufpool.c
+ * pool of the I/O buffers used by the read, write and readdir paths
+ *
+ * buffers are slabs of power of two size classes, freed slabs are kept in a
+ * small per-thread free list first, then in a global free list. The size of the
+ * buffers in use is bounded by the buffer_mem option, allocations wait for
+ * free memory when the bound is reached, until a fuse interruption or a limit
+ * */
+
+#include <string.h>
+
+#include "gfal_bufpool.h"
+#include "gfal_deadline.h"
+#include "params.h"
+
+#define GFALFS_BUFPOOL_MIN_SHIFT 9 // 512 bytes, also the accounting unit
+#define GFALFS_BUFPOOL_MAX_SHIFT 26 // 64M, larger buffers are not recycled
+#define GFALFS_BUFPOOL_CLASSES (GFALFS_BUFPOOL_MAX_SHIFT - GFALFS_BUFPOOL_MIN_SHIFT + 1)
+// free slabs kept by each thread
+#define GFALFS_BUFPOOL_THREAD_BYTES (1 << 22)
+#define GFALFS_BUFPOOL_THREAD_SLABS 8
+// check period of a waiting allocation, in micro-seconds
+#define GFALFS_BUFPOOL_WAIT_PERIOD 100000
+// longest wait of an allocation, in micro-seconds
+#define GFALFS_BUFPOOL_WAIT_MAX (30 * G_USEC_PER_SEC)
+
+typedef struct _gfalfs_buffer_header{
+	struct _gfalfs_buffer_header* next; // free list link
+	gint klass; // size class, -1 if the buffer is not recycled
+	gsize units; // accounted size
+} gfalfs_buffer_header;
+
+// keep the buffers aligned as malloc does
+#define GFALFS_BUFFER_HEADER_SIZE 32
+
+typedef struct _gfalfs_thread_cache{
+	gfalfs_buffer_header* slabs[GFALFS_BUFPOOL_CLASSES];
+	guint count[GFALFS_BUFPOOL_CLASSES];
+	gsize bytes;
+} gfalfs_thread_cache;
+
+// units of the buffers in use and of the slabs in the thread free lists
+static volatile gint pool_in_use = 0;
+static volatile gint pool_thread_idle = 0;
+static volatile gint pool_waiters = 0;
+
+// global free lists, protected by pool_mutex
+static GStaticMutex pool_mutex = G_STATIC_MUTEX_INIT;
+static GCond* pool_cond = NULL;
+static gfalfs_buffer_header* pool_slabs[GFALFS_BUFPOOL_CLASSES];
+static guint64 pool_idle = 0; // bytes
+static guint64 pool_waits = 0;
+
+static GStaticPrivate thread_cache_key = G_STATIC_PRIVATE_INIT;
+
+
+// cap in units, the counters of the units stay far from the gint limit
+static gsize gfalfs_bufpool_cap(){
+	return (gsize) MIN(gfalfs_get_buffer_mem() >> GFALFS_BUFPOOL_MIN_SHIFT, G_MAXINT / 2);
+}
+
+static gsize gfalfs_slab_size(gint klass){
+	return ((gsize) 1) << (klass + GFALFS_BUFPOOL_MIN_SHIFT);
+}
+
+static gint gfalfs_size_class(size_t size){
+	gint klass = 0;
+	while(klass < GFALFS_BUFPOOL_CLASSES && gfalfs_slab_size(klass) < size)
+		++klass;
+	return (klass < GFALFS_BUFPOOL_CLASSES)?klass:-1;
+}
+
+static char* gfalfs_buffer_data(gfalfs_buffer_header* header){
+	return ((char*) header) + GFALFS_BUFFER_HEADER_SIZE;
+}
+
+static gfalfs_buffer_header* gfalfs_buffer_get_header(char* buffer){
+	return (gfalfs_buffer_header*) (buffer - GFALFS_BUFFER_HEADER_SIZE);
+}
+
+// store a free slab in the global lists, release it if too much memory is idle
+static void gfalfs_bufpool_put_global(gfalfs_buffer_header* header){
+	const gsize size = ((gsize) header->units) << GFALFS_BUFPOOL_MIN_SHIFT;
+	g_static_mutex_lock(&pool_mutex);
+	if(header->klass >= 0 && pool_idle + size <= gfalfs_get_buffer_mem() / 4){
+		header->next = pool_slabs[header->klass];
+		pool_slabs[header->klass] = header;
+		pool_idle += size;
+		header = NULL;
+	}
+	g_static_mutex_unlock(&pool_mutex);
+	g_free(header);
+}
+
+static gfalfs_buffer_header* gfalfs_bufpool_get_global(gint klass){
+	gfalfs_buffer_header* header = NULL;
+	g_static_mutex_lock(&pool_mutex);
+	if(pool_slabs[klass] != NULL){
+		header = pool_slabs[klass];
+		pool_slabs[klass] = header->next;
+		pool_idle -= gfalfs_slab_size(klass);
+	}
+	g_static_mutex_unlock(&pool_mutex);
+	return header;
+}
+
+static void gfalfs_thread_cache_delete(gpointer data){
+	gfalfs_thread_cache* cache = (gfalfs_thread_cache*) data;
+	gint klass;
+	for(klass = 0; klass < GFALFS_BUFPOOL_CLASSES; ++klass){
+		while(cache->slabs[klass] != NULL){
+			gfalfs_buffer_header* header = cache->slabs[klass];
+			cache->slabs[klass] = header->next;
+			g_atomic_int_add(&pool_thread_idle, -((gint) header->units));
+			gfalfs_bufpool_put_global(header);
+		}
+	}
+	g_free(cache);
+}
+
+static gfalfs_thread_cache* gfalfs_thread_cache_get(){
+	gfalfs_thread_cache* cache = g_static_private_get(&thread_cache_key);
+	if(cache == NULL){
+		cache = g_new0(gfalfs_thread_cache, 1);
+		g_static_private_set(&thread_cache_key, cache, gfalfs_thread_cache_delete);
+	}
+	return cache;
+}
+
+// give back units to the memory cap and wake up the waiting allocations
+static void gfalfs_bufpool_release(gint units){
+	g_atomic_int_add(&pool_in_use, -units);
+	if(g_atomic_int_get(&pool_waiters) > 0){
+		g_static_mutex_lock(&pool_mutex);
+		g_cond_broadcast(pool_cond);
+		g_static_mutex_unlock(&pool_mutex);
+	}
+}
+
+// units never exceeds the cap, a failed attempt does not wake up the waiters, they check again periodically
+static gboolean gfalfs_bufpool_try_reserve(gint units){
+	const gint old = g_atomic_int_exchange_and_add(&pool_in_use, units);
+	if((gsize) (old + units) <= gfalfs_bufpool_cap())
+		return TRUE;
+	g_atomic_int_add(&pool_in_use, -units);
+	return FALSE;
+}
+
+// FALSE if the memory is not available before an interruption or the wait limit
+static gboolean gfalfs_bufpool_reserve(gint units){
+	gboolean res = TRUE;
+	if(gfalfs_bufpool_try_reserve(units))
+		return TRUE;
+	const gint64 limit = g_get_monotonic_time() + GFALFS_BUFPOOL_WAIT_MAX;
+	g_static_mutex_lock(&pool_mutex);
+	if(pool_cond == NULL)
+		pool_cond = g_cond_new();
+	pool_waits += 1;
+	g_atomic_int_inc(&pool_waiters);
+	while(gfalfs_bufpool_try_reserve(units) == FALSE){
+		if(g_get_monotonic_time() >= limit || gfalfs_deadline_interrupted()){
+			res = FALSE;
+			break;
+		}
+		GTimeVal deadline;
+		g_get_current_time(&deadline);
+		g_time_val_add(&deadline, GFALFS_BUFPOOL_WAIT_PERIOD);
+		g_cond_timed_wait(pool_cond, g_static_mutex_get_mutex(&pool_mutex), &deadline);
+	}
+	g_atomic_int_add(&pool_waiters, -1);
+	g_static_mutex_unlock(&pool_mutex);
+	return res;
+}
+
+char* gfalfs_buffer_alloc(size_t size){
+	const gsize cap = gfalfs_bufpool_cap();
+	const gint klass = (size <= (cap << GFALFS_BUFPOOL_MIN_SHIFT))?gfalfs_size_class(size):-1;
+	const gsize capacity = (klass >= 0)?gfalfs_slab_size(klass):
+				((size + (1 << GFALFS_BUFPOOL_MIN_SHIFT) - 1) & ~((gsize) (1 << GFALFS_BUFPOOL_MIN_SHIFT) - 1));
+	const gsize units = capacity >> GFALFS_BUFPOOL_MIN_SHIFT;
+	gfalfs_buffer_header* header = NULL;
+
+	if(size > (cap << GFALFS_BUFPOOL_MIN_SHIFT) || units > cap){ // could never be reserved
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_buffer_alloc %lu bytes requested, more than buffer_mem", (unsigned long) size);
+		return NULL;
+	}
+
+	if(gfalfs_bufpool_reserve((gint) units) == FALSE){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_buffer_alloc no memory for %lu bytes, buffer_mem reached", (unsigned long) size);
+		return NULL;
+	}
+	if(klass >= 0){
+		gfalfs_thread_cache* cache = gfalfs_thread_cache_get();
+		if(cache->slabs[klass] != NULL){
+			header = cache->slabs[klass];
+			cache->slabs[klass] = header->next;
+			cache->count[klass] -= 1;
+			cache->bytes -= capacity;
+			g_atomic_int_add(&pool_thread_idle, -((gint) units));
+		}else{
+			header = gfalfs_bufpool_get_global(klass);
+		}
+	}
+	if(header == NULL){
+		header = g_malloc(GFALFS_BUFFER_HEADER_SIZE + capacity);
+		header->klass = klass;
+		header->units = units;
+	}
+	header->next = NULL;
+	return gfalfs_buffer_data(header);
+}
+
+void gfalfs_buffer_free(char* buffer){
+	if(buffer == NULL)
+		return;
+	gfalfs_buffer_header* header = gfalfs_buffer_get_header(buffer);
+	const gsize units = header->units;
+	const gsize capacity = units << GFALFS_BUFPOOL_MIN_SHIFT;
+	gfalfs_thread_cache* cache = (header->klass >= 0)?gfalfs_thread_cache_get():NULL;
+	if(cache && cache->count[header->klass] < GFALFS_BUFPOOL_THREAD_SLABS
+			&& cache->bytes + capacity <= GFALFS_BUFPOOL_THREAD_BYTES){
+		header->next = cache->slabs[header->klass];
+		cache->slabs[header->klass] = header;
+		cache->count[header->klass] += 1;
+		cache->bytes += capacity;
+		g_atomic_int_add(&pool_thread_idle, (gint) units);
+	}else{
+		gfalfs_bufpool_put_global(header);
+	}
+	gfalfs_bufpool_release((gint) units);
+}
+
+void gfalfs_bufpool_get_stats(guint64* in_use, guint64* idle, guint64* waits){
+	g_static_mutex_lock(&pool_mutex);
+	*in_use = ((guint64) g_atomic_int_get(&pool_in_use)) << GFALFS_BUFPOOL_MIN_SHIFT;
+	*idle = pool_idle + (((guint64) g_atomic_int_get(&pool_thread_idle)) << GFALFS_BUFPOOL_MIN_SHIFT);
+	*waits = pool_waits;
+	g_static_mutex_unlock(&pool_mutex);
+}
@@ -0,0 +1,33 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_bufpool.h
+ * @brief pool of the I/O buffers, bounded by a global memory cap
+ */
+
+#include <stddef.h>
+#include <glib.h>
+
+// allocate a buffer of at least size bytes, wait while the memory cap is reached
+// NULL if fuse interrupts the request or if no memory is given back in 30 seconds
+char* gfalfs_buffer_alloc(size_t size);
+
+// give back a buffer to the pool, NULL is ignored
+void gfalfs_buffer_free(char* buffer);
+
+// bytes of the buffers in use, bytes kept for reuse, allocations delayed by the memory cap
+void gfalfs_bufpool_get_stats(guint64* in_use, guint64* idle, guint64* waits);
@@ -0,0 +1,550 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+
+/*
+ * gfal_bulk.c
+ * bulk namespace operations
+ *
+ * the unlinks of the fuse threads are queued and drained by a few workers,
+ * each worker sends the queued unlinks in one gfal2_unlink_list call, so
+ * concurrent or pipelined unlinks share their round trips to the storage.
+ * gfal2 falls back to one call per file for the protocols without bulk delete.
+ * A path with a queued unlink does not exist for getattr, the operations
+ * creating it wait for the unlink, and the operations on a directory wait for
+ * the unlinks of its content
+ * */
+
+#include <errno.h>
+#include <string.h>
+
+#include <gfal_api.h>
+#include <transfer/gfal_transfer.h>
+
+#include "gfal_bulk.h"
+#include "gfal_cache.h"
+#include "gfal_deadline.h"
+#include "gfal_mounts.h"
+#include "gfal_opers.h"
+#include "params.h"
+
+typedef struct _gfalfs_unlink_item{
+	gint ref; // queue and waiting fuse thread
+	char* path;
+	char* url;
+	int errcode;
+	gboolean done;
+} gfalfs_unlink_item;
+
+typedef enum{
+	GFALFS_TREE_RMTREE,
+	GFALFS_TREE_COPY
+} gfalfs_tree_task_type;
+
+typedef struct _gfalfs_tree_task{
+	gfalfs_tree_task_type type;
+	char* path; // local path of the source
+	char* url;
+	char* dest_path; // local path of the destination, NULL if outside of the mount
+	char* dest_url;
+} gfalfs_tree_task;
+
+static GStaticMutex bulk_mutex = G_STATIC_MUTEX_INIT;
+static GCond* bulk_cond = NULL; // a queued unlink is done or dequeued
+static GQueue unlink_queue = G_QUEUE_INIT;
+static GHashTable* pending_paths = NULL; // local path -> queued unlinks
+static guint ns_pending = 0;
+static guint drainers = 0;
+static GThreadPool* drain_pool = NULL;
+static GThreadPool* tree_pool = NULL;
+static gfal2_context_t bulk_context = NULL;
+
+static volatile gint stat_ns_failures = 0;
+static volatile gint stat_tree_pending = 0;
+static volatile gint stat_tree_failures = 0;
+
+// period of the deadline and interruption checks of a waiting unlink, in micro-seconds
+#define GFALFS_BULK_CHECK_PERIOD 100000
+
+static void gfalfs_bulk_drain(gpointer data, gpointer user_data);
+static void gfalfs_tree_worker(gpointer data, gpointer user_data);
+
+
+gfalfs_ns_safety gfalfs_ns_safety_from_name(const char* name){
+	if(name == NULL)
+		return GFALFS_NS_INVALID;
+	if(strcmp(name, "sync") == 0)
+		return GFALFS_NS_SYNC;
+	if(strcmp(name, "batch") == 0)
+		return GFALFS_NS_BATCH;
+	if(strcmp(name, "async") == 0)
+		return GFALFS_NS_ASYNC;
+	return GFALFS_NS_INVALID;
+}
+
+gboolean gfalfs_bulk_enabled(){
+	return gfalfs_get_ns_safety() != GFALFS_NS_SYNC;
+}
+
+// must be called with bulk_mutex
+static void gfalfs_bulk_init(){
+	if(bulk_cond != NULL)
+		return;
+	bulk_cond = g_cond_new();
+	pending_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	drain_pool = g_thread_pool_new(gfalfs_bulk_drain, NULL, (gint) gfalfs_get_bulk_threads(), FALSE, NULL);
+	tree_pool = g_thread_pool_new(gfalfs_tree_worker, NULL, (gint) gfalfs_get_bulk_threads(), FALSE, NULL);
+}
+
+// context of the gfal2 bulk calls, NULL if it can not be created
+static gfal2_context_t gfalfs_bulk_context(){
+	GError* tmp_err = NULL;
+	g_static_mutex_lock(&bulk_mutex);
+	if(bulk_context == NULL && (bulk_context = gfal2_context_new(&tmp_err)) == NULL){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_bulk context err : %s", (tmp_err)?tmp_err->message:"unknown");
+		g_clear_error(&tmp_err);
+	}
+	g_static_mutex_unlock(&bulk_mutex);
+	return bulk_context;
+}
+
+// delete n urls with one bulk call, errcodes receives the error of each url
+static void gfalfs_bulk_unlink_urls(const char** urls, int n, int* errcodes){
+	gfal2_context_t context = gfalfs_bulk_context();
+	int i;
+	if(context == NULL){
+		for(i = 0; i < n; ++i){
+			errcodes[i] = (gfal_unlink(urls[i]) < 0)?gfal_posix_code_error():0;
+			gfal_posix_clear_error();
+		}
+		return;
+	}
+	GError** errors = g_new0(GError*, n);
+	gfal2_unlink_list(context, n, urls, errors);
+	for(i = 0; i < n; ++i){
+		errcodes[i] = (errors[i])?errors[i]->code:0;
+		if(errors[i])
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_bulk unlink err %d for path %s: %s", errors[i]->code, (char*) urls[i], errors[i]->message);
+		g_clear_error(&(errors[i]));
+	}
+	g_free(errors);
+}
+
+static void gfalfs_unlink_item_unref(gfalfs_unlink_item* item){
+	if(g_atomic_int_dec_and_test(&(item->ref))){
+		g_free(item->path);
+		g_free(item->url);
+		g_free(item);
+	}
+}
+
+static void gfalfs_unlink_item_done(gfalfs_unlink_item* item, int errcode){
+	g_static_mutex_lock(&bulk_mutex);
+	const guint count = GPOINTER_TO_UINT(g_hash_table_lookup(pending_paths, item->path));
+	if(count <= 1)
+		g_hash_table_remove(pending_paths, item->path);
+	else
+		g_hash_table_insert(pending_paths, g_strdup(item->path), GUINT_TO_POINTER(count - 1));
+	ns_pending--;
+	item->errcode = errcode;
+	item->done = TRUE;
+	g_cond_broadcast(bulk_cond);
+	g_static_mutex_unlock(&bulk_mutex);
+	if(errcode != 0)
+		g_atomic_int_inc(&stat_ns_failures);
+	gfalfs_cache_invalidate(item->path); // a failed unlink makes the file visible again
+	gfalfs_unlink_item_unref(item);
+}
+
+static void gfalfs_bulk_drain(gpointer data, gpointer user_data){
+	const guint max = (guint) gfalfs_get_bulk_size();
+	gfalfs_unlink_item** batch = g_new(gfalfs_unlink_item*, max);
+	const char** urls = g_new(const char*, max);
+	int* errcodes = g_new(int, max);
+	guint n, i;
+	gfalfs_deadline_background_thread();
+	for(;;){
+		g_static_mutex_lock(&bulk_mutex);
+		for(n = 0; n < max && (batch[n] = g_queue_pop_head(&unlink_queue)) != NULL; ++n)
+			urls[n] = batch[n]->url;
+		if(n == 0){
+			drainers--;
+			g_static_mutex_unlock(&bulk_mutex);
+			break;
+		}
+		g_cond_broadcast(bulk_cond); // room in the queue
+		g_static_mutex_unlock(&bulk_mutex);
+
+		gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_bulk unlink of %u files", n);
+		gfalfs_bulk_unlink_urls(urls, n, errcodes);
+		for(i = 0; i < n; ++i)
+			gfalfs_unlink_item_done(batch[i], errcodes[i]);
+	}
+	g_free(errcodes);
+	g_free(urls);
+	g_free(batch);
+}
+
+// wait on bulk_cond, return 0 or -errno once the deadline expired or fuse interrupted the wait
+static int gfalfs_bulk_wait_unlink(gint64 deadline){
+	GTimeVal tv;
+	g_get_current_time(&tv);
+	g_time_val_add(&tv, GFALFS_BULK_CHECK_PERIOD);
+	g_cond_timed_wait(bulk_cond, g_static_mutex_get_mutex(&bulk_mutex), &tv);
+	if(gfalfs_deadline_interrupted())
+		return -(ECANCELED);
+	if(deadline > 0 && g_get_monotonic_time() >= deadline)
+		return -(ETIMEDOUT);
+	return 0;
+}
+
+// deadline of a wait for the queued unlinks, 0 if none
+static gint64 gfalfs_bulk_deadline(){
+	return (gfalfs_get_ns_timeout() > 0)?(g_get_monotonic_time() + ((gint64) gfalfs_get_ns_timeout()) * G_USEC_PER_SEC):0;
+}
+
+// remove an unlink not taken by a drainer yet, must be called with bulk_mutex
+static gboolean gfalfs_bulk_dequeue(gfalfs_unlink_item* item){
+	if(g_queue_remove(&unlink_queue, item) == FALSE)
+		return FALSE;
+	const guint count = GPOINTER_TO_UINT(g_hash_table_lookup(pending_paths, item->path));
+	if(count <= 1)
+		g_hash_table_remove(pending_paths, item->path);
+	else
+		g_hash_table_insert(pending_paths, g_strdup(item->path), GUINT_TO_POINTER(count - 1));
+	ns_pending--;
+	g_cond_broadcast(bulk_cond);
+	g_atomic_int_add(&(item->ref), -1); // reference of the queue, the caller holds the other one
+	return TRUE;
+}
+
+// the wait of a batch unlink has the namespace deadline, an unlink not sent yet is dequeued after it
+int gfalfs_bulk_unlink(const char* path, const char* url){
+	const gboolean async = (gfalfs_get_ns_safety() == GFALFS_NS_ASYNC);
+	const guint max_pending = (guint) (gfalfs_get_bulk_size() * gfalfs_get_bulk_threads() * 4);
+	const gint64 deadline = gfalfs_bulk_deadline();
+	int errcode = 0;
+
+	g_static_mutex_lock(&bulk_mutex);
+	gfalfs_bulk_init();
+	while(ns_pending >= max_pending){ // the queue is full, wait for the storage
+		if( (errcode = gfalfs_bulk_wait_unlink(deadline)) < 0){
+			g_static_mutex_unlock(&bulk_mutex);
+			return errcode;
+		}
+	}
+	gfalfs_unlink_item* item = g_new0(gfalfs_unlink_item, 1);
+	item->ref = (async)?1:2;
+	item->path = g_strdup(path);
+	item->url = g_strdup(url);
+	g_queue_push_tail(&unlink_queue, item);
+	ns_pending++;
+	const guint count = GPOINTER_TO_UINT(g_hash_table_lookup(pending_paths, path));
+	g_hash_table_insert(pending_paths, g_strdup(path), GUINT_TO_POINTER(count + 1));
+	if(drainers < gfalfs_get_bulk_threads()){
+		drainers++;
+		g_thread_pool_push(drain_pool, GINT_TO_POINTER(1), NULL);
+	}
+	if(async){
+		g_static_mutex_unlock(&bulk_mutex);
+		return 0;
+	}
+	while(item->done == FALSE && errcode == 0)
+		errcode = gfalfs_bulk_wait_unlink(deadline);
+	if(item->done)
+		errcode = -(item->errcode);
+	const gboolean dequeued = (item->done == FALSE && gfalfs_bulk_dequeue(item));
+	g_static_mutex_unlock(&bulk_mutex);
+	if(dequeued){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_bulk unlink of %s cancelled before its bulk call, err %d", (char*) path, -errcode);
+		gfalfs_cache_invalidate(path); // the file is visible again
+	}
+	gfalfs_unlink_item_unref(item);
+	return errcode;
+}
+
+gboolean gfalfs_bulk_pending(const char* path){
+	gboolean res = FALSE;
+	if(gfalfs_bulk_enabled() == FALSE)
+		return FALSE;
+	g_static_mutex_lock(&bulk_mutex);
+	if(ns_pending > 0)
+		res = g_hash_table_lookup(pending_paths, path) != NULL;
+	g_static_mutex_unlock(&bulk_mutex);
+	return res;
+}
+
+int gfalfs_bulk_wait_path(const char* path){
+	const gint64 deadline = gfalfs_bulk_deadline();
+	int errcode = 0;
+	if(gfalfs_bulk_enabled() == FALSE)
+		return 0;
+	g_static_mutex_lock(&bulk_mutex);
+	while(errcode == 0 && ns_pending > 0 && g_hash_table_lookup(pending_paths, path) != NULL)
+		errcode = gfalfs_bulk_wait_unlink(deadline);
+	g_static_mutex_unlock(&bulk_mutex);
+	return errcode;
+}
+
+// TRUE if a queued unlink is in the directory dir, must be called with bulk_mutex
+static gboolean gfalfs_bulk_pending_under(const char* dir){
+	const size_t s_dir = (strcmp(dir, "/") == 0)?0:strlen(dir);
+	GHashTableIter iter;
+	gpointer key;
+	g_hash_table_iter_init(&iter, pending_paths);
+	while(g_hash_table_iter_next(&iter, &key, NULL)){
+		const char* p = (const char*) key;
+		if(strncmp(p, dir, s_dir) == 0 && p[s_dir] == '/')
+			return TRUE;
+	}
+	return FALSE;
+}
+
+int gfalfs_bulk_wait_tree(const char* path){
+	const gint64 deadline = gfalfs_bulk_deadline();
+	int errcode = 0;
+	if(gfalfs_bulk_enabled() == FALSE)
+		return 0;
+	g_static_mutex_lock(&bulk_mutex);
+	while(errcode == 0 && ns_pending > 0 && gfalfs_bulk_pending_under(path))
+		errcode = gfalfs_bulk_wait_unlink(deadline);
+	g_static_mutex_unlock(&bulk_mutex);
+	return errcode;
+}
+
+
+static char* gfalfs_tree_child(const char* parent, const char* name){
+	if(parent == NULL)
+		return NULL;
+	if(strcmp(parent, "/") == 0)
+		return g_strconcat("/", name, NULL);
+	return g_strconcat(parent, "/", name, NULL);
+}
+
+static gboolean gfalfs_tree_is_dir(const char* url, struct dirent* ent){
+	struct stat st;
+	if(ent->d_type != DT_UNKNOWN)
+		return ent->d_type == DT_DIR;
+	const gboolean res = gfal_lstat(url, &st) == 0 && S_ISDIR(st.st_mode);
+	gfal_posix_clear_error();
+	return res;
+}
+
+// list a remote directory, the urls of the files and of the sub-directories
+// with dirs NULL, all the urls go in files without probing their type
+static int gfalfs_tree_list(const char* url, GPtrArray* files, GPtrArray* dirs, GPtrArray* names){
+	char err_buff[1024];
+	struct dirent* ent;
+	DIR* d = gfal_opendir(url);
+	if(d == NULL){
+		const int errcode = gfal_posix_code_error();
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_bulk opendir err %d for path %s: %s", errcode, (char*) url, (char*) gfal_posix_strerror_r(err_buff, 1024));
+		gfal_posix_clear_error();
+		return -errcode;
+	}
+	while( (ent = gfal_readdir(d)) != NULL){
+		if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+			continue;
+		char* child = g_strconcat(url, "/", ent->d_name, NULL);
+		if(names)
+			g_ptr_array_add(names, g_strdup(ent->d_name));
+		g_ptr_array_add((dirs != NULL && gfalfs_tree_is_dir(child, ent))?dirs:files, child);
+	}
+	const int errcode = gfal_posix_code_error();
+	gfal_posix_clear_error();
+	gfal_closedir(d);
+	gfal_posix_clear_error();
+	return -errcode;
+}
+
+// delete the content of a directory with bulk unlinks, then the directory
+static int gfalfs_tree_remove(const char* url){
+	char err_buff[1024];
+	GPtrArray* files = g_ptr_array_new_with_free_func(g_free);
+	GPtrArray* dirs = g_ptr_array_new_with_free_func(g_free);
+	int ret = gfalfs_tree_list(url, files, dirs, NULL);
+	guint i, j;
+	for(i = 0; i < dirs->len && ret == 0; ++i)
+		ret = gfalfs_tree_remove(g_ptr_array_index(dirs, i));
+	const guint chunk = (guint) gfalfs_get_bulk_size();
+	int* errcodes = g_new(int, chunk);
+	for(i = 0; i < files->len && ret == 0; i += chunk){
+		const guint n = MIN(chunk, files->len - i);
+		gfalfs_bulk_unlink_urls((const char**) files->pdata + i, n, errcodes);
+		for(j = 0; j < n; ++j)
+			if(errcodes[j] != 0 && errcodes[j] != ENOENT)
+				ret = -errcodes[j];
+	}
+	g_free(errcodes);
+	if(ret == 0 && gfal_rmdir(url) < 0){
+		ret = -(gfal_posix_code_error());
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_bulk rmdir err %d for path %s: %s", -ret, (char*) url, (char*) gfal_posix_strerror_r(err_buff, 1024));
+		gfal_posix_clear_error();
+	}
+	g_ptr_array_free(files, TRUE);
+	g_ptr_array_free(dirs, TRUE);
+	return ret;
+}
+
+static void gfalfs_tree_push(gfalfs_tree_task_type type, const char* path, const char* url, const char* dest_path, const char* dest_url){
+	gfalfs_tree_task* task = g_new0(gfalfs_tree_task, 1);
+	task->type = type;
+	task->path = g_strdup(path);
+	task->url = g_strdup(url);
+	task->dest_path = g_strdup(dest_path);
+	task->dest_url = g_strdup(dest_url);
+	g_atomic_int_inc(&stat_tree_pending);
+	g_static_mutex_lock(&bulk_mutex);
+	gfalfs_bulk_init();
+	g_static_mutex_unlock(&bulk_mutex);
+	g_thread_pool_push(tree_pool, task, NULL);
+}
+
+static int gfalfs_tree_copy_file(const char* url, const char* dest_url){
+	GError* tmp_err = NULL;
+	gfal2_context_t context = gfalfs_bulk_context();
+	if(context == NULL)
+		return -(EIO);
+	int ret = 0;
+	gfalt_params_t params = gfalt_params_handle_new(NULL);
+	gfalt_set_create_parent_dir(params, TRUE, NULL);
+	if(gfal2_copy_file(context, params, url, dest_url, &tmp_err) < 0){
+		ret = -(tmp_err->code);
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_bulk copy err %d for path %s to %s: %s", tmp_err->code, (char*) url, (char*) dest_url, tmp_err->message);
+		g_clear_error(&tmp_err);
+	}
+	gfalt_params_handle_delete(params, NULL);
+	return ret;
+}
+
+// copy a file, or create the directory and push the copies of its content
+static int gfalfs_tree_copy(gfalfs_tree_task* task){
+	char err_buff[1024];
+	struct stat st;
+	if(gfal_lstat(task->url, &st) < 0){
+		const int errcode = gfal_posix_code_error();
+		gfal_posix_clear_error();
+		return -errcode;
+	}
+	if(S_ISDIR(st.st_mode) == FALSE)
+		return gfalfs_tree_copy_file(task->url, task->dest_url);
+
+	if(gfal_mkdir(task->dest_url, st.st_mode & 07777) < 0 && gfal_posix_code_error() != EEXIST){
+		const int errcode = gfal_posix_code_error();
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_bulk mkdir err %d for path %s: %s", errcode, (char*) task->dest_url, (char*) gfal_posix_strerror_r(err_buff, 1024));
+		gfal_posix_clear_error();
+		return -errcode;
+	}
+	gfal_posix_clear_error();
+	GPtrArray* children = g_ptr_array_new_with_free_func(g_free);
+	GPtrArray* names = g_ptr_array_new_with_free_func(g_free);
+	const int ret = gfalfs_tree_list(task->url, children, NULL, names); // each child is stated by its own task
+	guint i;
+	for(i = 0; i < names->len && ret == 0; ++i){
+		const char* name = g_ptr_array_index(names, i);
+		char* path = gfalfs_tree_child(task->path, name);
+		char* dest_path = gfalfs_tree_child(task->dest_path, name);
+		char* url = g_strconcat(task->url, "/", name, NULL);
+		char* dest_url = g_strconcat(task->dest_url, "/", name, NULL);
+		gfalfs_tree_push(GFALFS_TREE_COPY, path, url, dest_path, dest_url);
+		g_free(path);
+		g_free(dest_path);
+		g_free(url);
+		g_free(dest_url);
+	}
+	g_ptr_array_free(children, TRUE);
+	g_ptr_array_free(names, TRUE);
+	return ret;
+}
+
+static void gfalfs_tree_worker(gpointer data, gpointer user_data){
+	gfalfs_tree_task* task = (gfalfs_tree_task*) data;
+	int ret;
+	gfalfs_deadline_background_thread();
+	if(task->type == GFALFS_TREE_RMTREE){
+		ret = gfalfs_tree_remove(task->url);
+		gfalfs_cache_invalidate_tree(task->path);
+	}else{
+		ret = gfalfs_tree_copy(task);
+		if(task->dest_path)
+			gfalfs_cache_invalidate(task->dest_path);
+	}
+	gfalfs_log(NULL, (ret < 0)?G_LOG_LEVEL_WARNING:G_LOG_LEVEL_MESSAGE, "gfalfs_bulk %s of %s done, err %d",
+				(task->type == GFALFS_TREE_RMTREE)?"rmtree":"copy", (char*) task->url, -ret);
+	if(ret < 0)
+		g_atomic_int_inc(&stat_tree_failures);
+	g_atomic_int_add(&stat_tree_pending, -1);
+	g_free(task->path);
+	g_free(task->url);
+	g_free(task->dest_path);
+	g_free(task->dest_url);
+	g_free(task);
+}
+
+static gboolean gfalfs_bulk_is_root(const char* path){
+	return strcmp(path, "/") == 0 || (gfalfs_mounts_enabled() && gfalfs_mounts_is_root(path));
+}
+
+int gfalfs_bulk_rmtree(const char* path){
+	char url[2048];
+	if(gfalfs_bulk_is_root(path)) // never the whole mount
+		return -(EPERM);
+	gfalfs_construct_path(path, url, 2048);
+	if(*url == '\0')
+		return -(ENOENT);
+	gfalfs_tree_push(GFALFS_TREE_RMTREE, path, url, NULL, NULL);
+	return 0;
+}
+
+// TRUE if url is the url parent or in its tree
+static gboolean gfalfs_bulk_url_under(const char* url, const char* parent){
+	size_t len = strlen(parent);
+	while(len > 0 && parent[len-1] == '/')
+		--len;
+	return strncmp(url, parent, len) == 0 && (url[len] == '\0' || url[len] == '/');
+}
+
+// the destination must be outside of the source tree, the copy would never end
+int gfalfs_bulk_copy(const char* path, const char* dest){
+	char url[2048];
+	char dest_path[2048];
+	char dest_url[2048];
+	gfalfs_construct_path(path, url, 2048);
+	if(*url == '\0')
+		return -(ENOENT);
+	if(strstr(dest, "://") != NULL){
+		g_strlcpy(dest_url, dest, 2048);
+		if(gfalfs_bulk_url_under(dest_url, url))
+			return -(EINVAL);
+		gfalfs_tree_push(GFALFS_TREE_COPY, path, url, NULL, dest_url);
+		return 0;
+	}
+	if(gfalfs_local_path_from_abs(dest, dest_path, 2048) == FALSE)
+		return -(EINVAL);
+	gfalfs_construct_path(dest_path, dest_url, 2048);
+	if(*dest_url == '\0' || gfalfs_bulk_is_root(dest_path) || gfalfs_bulk_url_under(dest_url, url))
+		return -(EINVAL);
+	gfalfs_tree_push(GFALFS_TREE_COPY, path, url, dest_path, dest_url);
+	return 0;
+}
+
+void gfalfs_bulk_get_stats(guint64* ns_queued, guint64* ns_failures, guint64* tree_pending, guint64* tree_failures){
+	g_static_mutex_lock(&bulk_mutex);
+	*ns_queued = ns_pending;
+	g_static_mutex_unlock(&bulk_mutex);
+	*ns_failures = g_atomic_int_get(&stat_ns_failures);
+	*tree_pending = g_atomic_int_get(&stat_tree_pending);
+	*tree_failures = g_atomic_int_get(&stat_tree_failures);
+}
@@ -0,0 +1,57 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_bulk.h
+ * @brief bulk namespace operations : pipelined unlinks grouped in gfal2 bulk
+ * calls, and recursive delete or copy of a tree in background
+ */
+
+#include <glib.h>
+
+typedef enum{
+	GFALFS_NS_SYNC=0, // each unlink waits for its own remote call
+	GFALFS_NS_BATCH, // each unlink waits for the bulk call which contains it
+	GFALFS_NS_ASYNC, // an unlink returns once queued, the failures are logged
+	GFALFS_NS_INVALID
+} gfalfs_ns_safety;
+
+// safety mode from its name, GFALFS_NS_INVALID if unknown
+gfalfs_ns_safety gfalfs_ns_safety_from_name(const char* name);
+
+// TRUE if the unlinks go through the bulk pipeline
+gboolean gfalfs_bulk_enabled();
+
+// queue the unlink of path, return 0 or -errno according to the safety mode
+int gfalfs_bulk_unlink(const char* path, const char* url);
+
+// TRUE if the unlink of path is queued
+gboolean gfalfs_bulk_pending(const char* path);
+
+// wait for the queued unlinks of path, or of the content of the directory path
+// return 0, or -errno after the namespace deadline or an interruption
+int gfalfs_bulk_wait_path(const char* path);
+int gfalfs_bulk_wait_tree(const char* path);
+
+// delete a tree in background, with bulk unlinks
+int gfalfs_bulk_rmtree(const char* path);
+
+// copy a file or a tree in background with third party copies, dest is an url or a local path of the mount
+// -EINVAL if dest is in the copied tree
+int gfalfs_bulk_copy(const char* path, const char* dest);
+
+// pending and failed background operations
+void gfalfs_bulk_get_stats(guint64* ns_pending, guint64* ns_failures, guint64* tree_pending, guint64* tree_failures);
@@ -0,0 +1,392 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * gfal_cache.c
+ * metadata cache of gfalFS
+ * */
+
+#include <string.h>
+
+#include "gfal_cache.h"
+#include "gfal_checksum.h"
+#include "gfal_blockcache.h"
+#include "gfal_ext.h"
+#include "params.h"
+
+typedef struct _gfalfs_stat_entry{
+	struct stat st;
+	gint64 timestamp; // monotonic time of the last update, 0 if st is not valid
+	// attributes at the time of the last open
+	gboolean opened;
+	time_t open_mtime;
+	off_t open_size;
+	// checksum of the verified content, empty if not trusted
+	char checksum[GFALFS_CHECKSUM_MAX_LEN];
+} gfalfs_stat_entry;
+
+typedef struct _gfalfs_listing_cache_entry{
+	gfalfs_listing listing;
+	gint64 timestamp;
+} gfalfs_listing_cache_entry;
+
+typedef struct _gfalfs_link_cache_entry{
+	char* target;
+	gint64 timestamp;
+} gfalfs_link_cache_entry;
+
+// generation of the last invalidation of a path, or of a tree
+typedef struct _gfalfs_invalidation{
+	guint64 generation;
+	gboolean tree;
+} gfalfs_invalidation;
+
+static GStaticMutex cache_mutex = G_STATIC_MUTEX_INIT;
+static GHashTable* stat_table = NULL;
+static GHashTable* listing_table = NULL;
+static GHashTable* link_table = NULL;
+// invalidations, a listing read before one of them is not stored
+static GHashTable* invalidation_table = NULL;
+static guint64 cache_generation = 0;
+static guint64 flush_generation = 0; // invalidations before are forgotten
+
+
+gboolean gfalfs_cache_enabled(){
+	return gfalfs_get_page_cache_mode() || gfalfs_get_md_cache_ttl() > 0 || gfalfs_get_readahead_mode()
+			|| gfalfs_get_offline_mode();
+}
+
+static gboolean gfalfs_cache_is_fresh_ttl(gint64 timestamp, guint64 ttl){
+	return timestamp != 0
+		&& (g_get_monotonic_time() - timestamp) < ((gint64) ttl) * G_USEC_PER_SEC;
+}
+
+static gboolean gfalfs_cache_is_fresh(gint64 timestamp){
+	return gfalfs_cache_is_fresh_ttl(timestamp, gfalfs_get_md_cache_ttl());
+}
+
+static void gfalfs_listing_cache_entry_delete(gpointer data){
+	gfalfs_listing_cache_entry* entry = (gfalfs_listing_cache_entry*) data;
+	gfalfs_listing_unref(entry->listing);
+	g_free(entry);
+}
+
+static void gfalfs_link_cache_entry_delete(gpointer data){
+	gfalfs_link_cache_entry* entry = (gfalfs_link_cache_entry*) data;
+	g_free(entry->target);
+	g_free(entry);
+}
+
+// the tables are flushed when they reach the max size
+static void gfalfs_cache_check_size(GHashTable* table){
+	if(g_hash_table_size(table) >= gfalfs_get_md_cache_size())
+		g_hash_table_remove_all(table);
+}
+
+static gfalfs_stat_entry* gfalfs_cache_get_entry(const char* path, gboolean create){
+	if(stat_table == NULL){
+		if(!create)
+			return NULL;
+		stat_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	}
+	gfalfs_stat_entry* entry = g_hash_table_lookup(stat_table, path);
+	if(entry == NULL && create){
+		gfalfs_cache_check_size(stat_table);
+		entry = g_new0(gfalfs_stat_entry, 1);
+		g_hash_table_insert(stat_table, g_strdup(path), entry);
+	}
+	return entry;
+}
+
+void gfalfs_cache_set_stat(const char* path, const struct stat* st){
+	g_static_mutex_lock(&cache_mutex);
+	gfalfs_stat_entry* entry = gfalfs_cache_get_entry(path, TRUE);
+	memcpy(&entry->st, st, sizeof(struct stat));
+	entry->timestamp = g_get_monotonic_time();
+	g_static_mutex_unlock(&cache_mutex);
+}
+
+gboolean gfalfs_cache_get_stat(const char* path, struct stat* st){
+	gboolean res = FALSE;
+	if(gfalfs_get_md_cache_ttl() == 0)
+		return FALSE;
+	g_static_mutex_lock(&cache_mutex);
+	gfalfs_stat_entry* entry = gfalfs_cache_get_entry(path, FALSE);
+	if(entry != NULL && gfalfs_cache_is_fresh(entry->timestamp)){
+		memcpy(st, &entry->st, sizeof(struct stat));
+		res = TRUE;
+	}
+	g_static_mutex_unlock(&cache_mutex);
+	return res;
+}
+
+gboolean gfalfs_cache_peek_stat(const char* path, struct stat* st){
+	gboolean res = FALSE;
+	g_static_mutex_lock(&cache_mutex);
+	gfalfs_stat_entry* entry = gfalfs_cache_get_entry(path, FALSE);
+	if(entry != NULL && entry->timestamp != 0){
+		memcpy(st, &entry->st, sizeof(struct stat));
+		res = TRUE;
+	}
+	g_static_mutex_unlock(&cache_mutex);
+	return res;
+}
+
+void gfalfs_cache_set_trusted(const char* path, const char* checksum){
+	g_static_mutex_lock(&cache_mutex);
+	gfalfs_stat_entry* entry = gfalfs_cache_get_entry(path, FALSE);
+	if(entry != NULL)
+		g_strlcpy(entry->checksum, (checksum)?checksum:"", GFALFS_CHECKSUM_MAX_LEN);
+	g_static_mutex_unlock(&cache_mutex);
+}
+
+gboolean gfalfs_cache_get_trusted(const char* path, char* buff, size_t s_buff){
+	gboolean res = FALSE;
+	g_static_mutex_lock(&cache_mutex);
+	gfalfs_stat_entry* entry = gfalfs_cache_get_entry(path, FALSE);
+	if(entry != NULL && *(entry->checksum) != '\0'){
+		g_strlcpy(buff, entry->checksum, s_buff);
+		res = TRUE;
+	}
+	g_static_mutex_unlock(&cache_mutex);
+	return res;
+}
+
+gboolean gfalfs_cache_open_unchanged(const char* path){
+	gboolean res = FALSE;
+	g_static_mutex_lock(&cache_mutex);
+	gfalfs_stat_entry* entry = gfalfs_cache_get_entry(path, FALSE);
+	if(entry != NULL && entry->timestamp != 0){
+		res = entry->opened
+				&& entry->open_mtime == entry->st.st_mtime
+				&& entry->open_size == entry->st.st_size;
+		entry->opened = TRUE;
+		entry->open_mtime = entry->st.st_mtime;
+		entry->open_size = entry->st.st_size;
+	}
+	g_static_mutex_unlock(&cache_mutex);
+	return res;
+}
+
+guint64 gfalfs_cache_generation(){
+	g_static_mutex_lock(&cache_mutex);
+	const guint64 res = cache_generation;
+	g_static_mutex_unlock(&cache_mutex);
+	return res;
+}
+
+// record an invalidation, called with the cache lock
+static void gfalfs_cache_record_invalidation(const char* path, gboolean tree){
+	if(invalidation_table == NULL)
+		invalidation_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	if(g_hash_table_size(invalidation_table) >= gfalfs_get_md_cache_size()){
+		g_hash_table_remove_all(invalidation_table);
+		flush_generation = cache_generation;
+	}
+	gfalfs_invalidation* inv = g_hash_table_lookup(invalidation_table, path);
+	if(inv == NULL){
+		inv = g_new0(gfalfs_invalidation, 1);
+		g_hash_table_insert(invalidation_table, g_strdup(path), inv);
+	}
+	inv->generation = ++cache_generation;
+	inv->tree = inv->tree || tree;
+}
+
+// TRUE if the path or one of its parent trees was invalidated after generation, called with the cache lock
+static gboolean gfalfs_cache_invalidated_since(const char* path, guint64 generation){
+	if(generation < flush_generation)
+		return TRUE;
+	if(invalidation_table == NULL)
+		return FALSE;
+	gfalfs_invalidation* inv = g_hash_table_lookup(invalidation_table, path);
+	if(inv != NULL && inv->generation > generation)
+		return TRUE;
+	char* parent = g_path_get_dirname(path);
+	gboolean res = FALSE;
+	while(res == FALSE){
+		inv = g_hash_table_lookup(invalidation_table, parent);
+		res = (inv != NULL && inv->tree && inv->generation > generation);
+		if(strcmp(parent, "/") == 0 || strcmp(parent, ".") == 0)
+			break;
+		char* next = g_path_get_dirname(parent);
+		g_free(parent);
+		parent = next;
+	}
+	g_free(parent);
+	return res;
+}
+
+void gfalfs_cache_set_listing(const char* path, gfalfs_listing listing, guint64 generation){
+	g_static_mutex_lock(&cache_mutex);
+	if(gfalfs_cache_invalidated_since(path, generation)){ // read before a change of the directory
+		g_static_mutex_unlock(&cache_mutex);
+		gfalfs_listing_unref(listing);
+		return;
+	}
+	if(listing_table == NULL)
+		listing_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, gfalfs_listing_cache_entry_delete);
+	gfalfs_cache_check_size(listing_table);
+	gfalfs_listing_cache_entry* entry = g_new0(gfalfs_listing_cache_entry, 1);
+	entry->listing = listing;
+	entry->timestamp = g_get_monotonic_time();
+	g_hash_table_replace(listing_table, g_strdup(path), entry);
+	g_static_mutex_unlock(&cache_mutex);
+}
+
+static gfalfs_listing gfalfs_cache_lookup_listing(const char* path, gboolean fresh){
+	gfalfs_listing res = NULL;
+	g_static_mutex_lock(&cache_mutex);
+	if(listing_table != NULL){
+		gfalfs_listing_cache_entry* entry = g_hash_table_lookup(listing_table, path);
+		if(entry != NULL && (!fresh || gfalfs_cache_is_fresh(entry->timestamp)))
+			res = gfalfs_listing_ref(entry->listing);
+	}
+	g_static_mutex_unlock(&cache_mutex);
+	return res;
+}
+
+gfalfs_listing gfalfs_cache_get_listing(const char* path){
+	if(gfalfs_get_md_cache_ttl() == 0)
+		return NULL;
+	return gfalfs_cache_lookup_listing(path, TRUE);
+}
+
+gfalfs_listing gfalfs_cache_peek_listing(const char* path){
+	return gfalfs_cache_lookup_listing(path, FALSE);
+}
+
+void gfalfs_cache_set_link(const char* path, const char* target){
+	if(gfalfs_get_link_cache_ttl() == 0 && gfalfs_get_offline_mode() == FALSE)
+		return;
+	g_static_mutex_lock(&cache_mutex);
+	if(link_table == NULL)
+		link_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, gfalfs_link_cache_entry_delete);
+	gfalfs_cache_check_size(link_table);
+	gfalfs_link_cache_entry* entry = g_new0(gfalfs_link_cache_entry, 1);
+	entry->target = g_strdup(target);
+	entry->timestamp = g_get_monotonic_time();
+	g_hash_table_replace(link_table, g_strdup(path), entry);
+	g_static_mutex_unlock(&cache_mutex);
+}
+
+static gboolean gfalfs_cache_lookup_link(const char* path, gboolean fresh, char* buff, size_t s_buff){
+	gboolean res = FALSE;
+	g_static_mutex_lock(&cache_mutex);
+	if(link_table != NULL){
+		gfalfs_link_cache_entry* entry = g_hash_table_lookup(link_table, path);
+		if(entry != NULL && (!fresh || gfalfs_cache_is_fresh_ttl(entry->timestamp, gfalfs_get_link_cache_ttl()))){
+			g_strlcpy(buff, entry->target, s_buff);
+			res = TRUE;
+		}
+	}
+	g_static_mutex_unlock(&cache_mutex);
+	return res;
+}
+
+gboolean gfalfs_cache_get_link(const char* path, char* buff, size_t s_buff){
+	if(gfalfs_get_link_cache_ttl() == 0)
+		return FALSE;
+	return gfalfs_cache_lookup_link(path, TRUE, buff, s_buff);
+}
+
+gboolean gfalfs_cache_peek_link(const char* path, char* buff, size_t s_buff){
+	return gfalfs_cache_lookup_link(path, FALSE, buff, s_buff);
+}
+
+void gfalfs_cache_invalidate(const char* path){
+	char* parent = g_path_get_dirname(path);
+	g_static_mutex_lock(&cache_mutex);
+	if(stat_table != NULL)
+		g_hash_table_remove(stat_table, path);
+	if(listing_table != NULL){
+		g_hash_table_remove(listing_table, path);
+		g_hash_table_remove(listing_table, parent);
+	}
+	if(link_table != NULL)
+		g_hash_table_remove(link_table, path);
+	gfalfs_cache_record_invalidation(path, FALSE);
+	gfalfs_cache_record_invalidation(parent, FALSE);
+	g_static_mutex_unlock(&cache_mutex);
+	g_free(parent);
+	if(gfalfs_get_readahead_mode())
+		gfalfs_blockcache_drop_file(gfalfs_path_ino(path));
+}
+
+void gfalfs_cache_invalidate_stat(const char* path){
+	g_static_mutex_lock(&cache_mutex);
+	if(stat_table != NULL)
+		g_hash_table_remove(stat_table, path);
+	g_static_mutex_unlock(&cache_mutex);
+}
+
+static gboolean gfalfs_cache_is_child(gpointer key, gpointer value, gpointer user_data){
+	const char* prefix = (const char*) user_data;
+	const size_t s_prefix = (strcmp(prefix, "/") == 0)?0:strlen(prefix); // every path is under the root
+	return strncmp((const char*) key, prefix, s_prefix) == 0 && ((const char*) key)[s_prefix] == '/';
+}
+
+static void gfalfs_cache_collect_child(gpointer key, gpointer value, gpointer user_data){
+	GPtrArray* children = (GPtrArray*) ((gpointer*) user_data)[1];
+	if(gfalfs_cache_is_child(key, value, ((gpointer*) user_data)[0]))
+		g_ptr_array_add(children, g_strdup((const char*) key));
+}
+
+void gfalfs_cache_invalidate_tree(const char* path){
+	GPtrArray* children = g_ptr_array_new();
+	gpointer collect_args[] = { (gpointer) path, children };
+	guint i;
+	gfalfs_cache_invalidate(path);
+	g_static_mutex_lock(&cache_mutex);
+	if(stat_table != NULL){
+		if(gfalfs_get_readahead_mode()) // the cached blocks of the known files
+			g_hash_table_foreach(stat_table, gfalfs_cache_collect_child, collect_args);
+		g_hash_table_foreach_remove(stat_table, gfalfs_cache_is_child, (gpointer) path);
+	}
+	if(listing_table != NULL)
+		g_hash_table_foreach_remove(listing_table, gfalfs_cache_is_child, (gpointer) path);
+	if(link_table != NULL)
+		g_hash_table_foreach_remove(link_table, gfalfs_cache_is_child, (gpointer) path);
+	gfalfs_cache_record_invalidation(path, TRUE);
+	g_static_mutex_unlock(&cache_mutex);
+	for(i = 0; i < children->len; ++i){
+		gfalfs_blockcache_drop_file(gfalfs_path_ino(g_ptr_array_index(children, i)));
+		g_free(g_ptr_array_index(children, i));
+	}
+	g_ptr_array_free(children, TRUE);
+}
+
+
+gfalfs_listing gfalfs_listing_new(GArray* entries){
+	gfalfs_listing res = g_new0(struct _gfalfs_listing, 1);
+	res->ref = 1;
+	res->n_entries = entries->len;
+	res->entries = (gfalfs_listing_entry*) g_array_free(entries, FALSE);
+	return res;
+}
+
+gfalfs_listing gfalfs_listing_ref(gfalfs_listing listing){
+	g_atomic_int_inc(&listing->ref);
+	return listing;
+}
+
+void gfalfs_listing_unref(gfalfs_listing listing){
+	if(listing && g_atomic_int_dec_and_test(&listing->ref)){
+		guint i;
+		for(i = 0; i < listing->n_entries; ++i)
+			g_free(listing->entries[i].name);
+		g_free(listing->entries);
+		g_free(listing);
+	}
+}
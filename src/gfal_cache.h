@@ -0,0 +1,98 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_cache.h
+ * @brief metadata cache of gfalFS
+ *
+ * attributes, directory listings and link targets are indexed by local path
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+typedef struct _gfalfs_listing_entry{
+	char* name;
+	unsigned char d_type;
+} gfalfs_listing_entry;
+
+// immutable directory listing, shared between the cache and the dir handles
+typedef struct _gfalfs_listing{
+	gint ref;
+	guint n_entries;
+	gfalfs_listing_entry* entries;
+} *gfalfs_listing;
+
+
+// TRUE if attributes have to be recorded (page cache mode or metadata cache)
+gboolean gfalfs_cache_enabled();
+
+// store the last known attributes of a path
+void gfalfs_cache_set_stat(const char* path, const struct stat* st);
+
+// get the attributes of a path if they are younger than the metadata cache ttl
+gboolean gfalfs_cache_get_stat(const char* path, struct stat* st);
+
+// get the last known attributes of a path, even if they are older than the ttl
+gboolean gfalfs_cache_peek_stat(const char* path, struct stat* st);
+
+// mark the content of a path as verified with the given checksum
+void gfalfs_cache_set_trusted(const char* path, const char* checksum);
+
+// get the verified checksum of a path, FALSE if the content is not trusted
+gboolean gfalfs_cache_get_trusted(const char* path, char* buff, size_t s_buff);
+
+// return TRUE if the path did not change since its previous open, the kernel cache can be kept
+gboolean gfalfs_cache_open_unchanged(const char* path);
+
+// current invalidation generation, to take before reading a listing
+guint64 gfalfs_cache_generation();
+
+// store a complete listing of a directory read since generation, the listing is consumed
+// a listing read before an invalidation of the directory is dropped
+void gfalfs_cache_set_listing(const char* path, gfalfs_listing listing, guint64 generation);
+
+// get a fresh listing of a directory, NULL if none, to release with gfalfs_listing_unref
+gfalfs_listing gfalfs_cache_get_listing(const char* path);
+
+// get the last known listing of a directory, even if it is older than the ttl
+gfalfs_listing gfalfs_cache_peek_listing(const char* path);
+
+// store the target of a link, already converted to a local path
+void gfalfs_cache_set_link(const char* path, const char* target);
+
+// get the target of a link if it is younger than the link cache ttl
+gboolean gfalfs_cache_get_link(const char* path, char* buff, size_t s_buff);
+
+// get the last known target of a link, even if it is older than the ttl
+gboolean gfalfs_cache_peek_link(const char* path, char* buff, size_t s_buff);
+
+// forget everything known about a path and the listing of its parent
+void gfalfs_cache_invalidate(const char* path);
+
+// forget the attributes of a path, its content changed
+void gfalfs_cache_invalidate_stat(const char* path);
+
+// same as gfalfs_cache_invalidate, for all the content of a directory too
+void gfalfs_cache_invalidate_tree(const char* path);
+
+
+gfalfs_listing gfalfs_listing_new(GArray* entries);
+
+gfalfs_listing gfalfs_listing_ref(gfalfs_listing listing);
+
+void gfalfs_listing_unref(gfalfs_listing listing);
@@ -0,0 +1,295 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * gfal_checksum.c
+ * incremental adler32, crc32c and md5 checksums
+ *
+ * adler32 and crc32c use the SSSE3 and SSE4.2 instructions when the cpu supports them
+ * */
+
+#include <errno.h>
+#include <string.h>
+
+#include <gfal_api.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define GFALFS_CHECKSUM_X86 1
+#include <immintrin.h>
+#endif
+
+#include "gfal_checksum.h"
+#include "gfal_deadline.h"
+#include "params.h"
+
+#define GFALFS_XATTR_CHECKSUM "user.checksum"
+
+// largest n such that 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1
+#define ADLER_BASE 65521
+#define ADLER_NMAX 5552
+
+#define CRC32C_POLY 0x82F63B78
+
+
+static guint32 gfalfs_adler32_generic(guint32 adler, const unsigned char* buf, size_t len){
+	guint32 s1 = adler & 0xffff;
+	guint32 s2 = adler >> 16;
+	while(len > 0){
+		size_t n = MIN(len, ADLER_NMAX);
+		len -= n;
+		for(; n >= 8; n -= 8, buf += 8){
+			s2 += (s1 += buf[0]); s2 += (s1 += buf[1]);
+			s2 += (s1 += buf[2]); s2 += (s1 += buf[3]);
+			s2 += (s1 += buf[4]); s2 += (s1 += buf[5]);
+			s2 += (s1 += buf[6]); s2 += (s1 += buf[7]);
+		}
+		for(; n > 0; --n)
+			s2 += (s1 += *buf++);
+		s1 %= ADLER_BASE;
+		s2 %= ADLER_BASE;
+	}
+	return s1 | (s2 << 16);
+}
+
+static guint32 crc32c_table[256];
+static volatile gint crc32c_table_init = 0;
+
+static void gfalfs_crc32c_init_table(){
+	guint32 i, j;
+	for(i = 0; i < 256; ++i){
+		guint32 c = i;
+		for(j = 0; j < 8; ++j)
+			c = (c & 1)?((c >> 1) ^ CRC32C_POLY):(c >> 1);
+		crc32c_table[i] = c;
+	}
+	g_atomic_int_set(&crc32c_table_init, 1);
+}
+
+static guint32 gfalfs_crc32c_generic(guint32 crc, const unsigned char* buf, size_t len){
+	if(!g_atomic_int_get(&crc32c_table_init))
+		gfalfs_crc32c_init_table(); // idempotent, concurrent inits are harmless
+	crc = ~crc;
+	while(len--)
+		crc = crc32c_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+#ifdef GFALFS_CHECKSUM_X86
+
+// 32 bytes per iteration : sum of the bytes with psadbw, weighted sum with pmaddubsw
+__attribute__((target("ssse3")))
+static guint32 gfalfs_adler32_ssse3(guint32 adler, const unsigned char* buf, size_t len){
+	guint32 s1 = adler & 0xffff;
+	guint32 s2 = adler >> 16;
+	size_t blocks = len / 32;
+	len -= blocks * 32;
+
+	const __m128i tap1 = _mm_setr_epi8(32,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17);
+	const __m128i tap2 = _mm_setr_epi8(16,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi16(1);
+
+	while(blocks > 0){
+		size_t n = MIN(blocks, ADLER_NMAX / 32);
+		blocks -= n;
+		__m128i v_ps = _mm_set_epi32(0, 0, 0, s1 * n);
+		__m128i v_s2 = _mm_set_epi32(0, 0, 0, s2);
+		__m128i v_s1 = zero;
+		do{
+			const __m128i bytes1 = _mm_loadu_si128((const __m128i*) buf);
+			const __m128i bytes2 = _mm_loadu_si128((const __m128i*) (buf + 16));
+			v_ps = _mm_add_epi32(v_ps, v_s1);
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+			buf += 32;
+		}while(--n);
+		v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+		v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(2,3,0,1)));
+		v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1,0,3,2)));
+		s1 += (guint32) _mm_cvtsi128_si32(v_s1);
+		v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2,3,0,1)));
+		v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1,0,3,2)));
+		s2 = (guint32) _mm_cvtsi128_si32(v_s2);
+		s1 %= ADLER_BASE;
+		s2 %= ADLER_BASE;
+	}
+	return gfalfs_adler32_generic(s1 | (s2 << 16), buf, len);
+}
+
+__attribute__((target("sse4.2")))
+static guint32 gfalfs_crc32c_sse42(guint32 crc, const unsigned char* buf, size_t len){
+	crc = ~crc;
+	for(; len > 0 && ((gsize) buf & 7) != 0; --len)
+		crc = _mm_crc32_u8(crc, *buf++);
+#ifdef __x86_64__
+	guint64 crc64 = crc;
+	for(; len >= 8; len -= 8, buf += 8){
+		guint64 word;
+		memcpy(&word, buf, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = (guint32) crc64;
+#endif
+	for(; len >= 4; len -= 4, buf += 4){
+		guint32 word;
+		memcpy(&word, buf, 4);
+		crc = _mm_crc32_u32(crc, word);
+	}
+	for(; len > 0; --len)
+		crc = _mm_crc32_u8(crc, *buf++);
+	return ~crc;
+}
+
+#endif
+
+guint32 gfalfs_adler32(guint32 adler, const unsigned char* buf, size_t len){
+#ifdef GFALFS_CHECKSUM_X86
+	if(__builtin_cpu_supports("ssse3"))
+		return gfalfs_adler32_ssse3(adler, buf, len);
+#endif
+	return gfalfs_adler32_generic(adler, buf, len);
+}
+
+guint32 gfalfs_crc32c(guint32 crc, const unsigned char* buf, size_t len){
+#ifdef GFALFS_CHECKSUM_X86
+	if(__builtin_cpu_supports("sse4.2"))
+		return gfalfs_crc32c_sse42(crc, buf, len);
+#endif
+	return gfalfs_crc32c_generic(crc, buf, len);
+}
+
+
+gfalfs_checksum_type gfalfs_checksum_type_from_name(const char* name){
+	if(name == NULL)
+		return GFALFS_CHECKSUM_NONE;
+	if(g_ascii_strcasecmp(name, "adler32") == 0)
+		return GFALFS_CHECKSUM_ADLER32;
+	if(g_ascii_strcasecmp(name, "crc32c") == 0)
+		return GFALFS_CHECKSUM_CRC32C;
+	if(g_ascii_strcasecmp(name, "md5") == 0)
+		return GFALFS_CHECKSUM_MD5;
+	return GFALFS_CHECKSUM_NONE;
+}
+
+const char* gfalfs_checksum_type_name(gfalfs_checksum_type type){
+	switch(type){
+		case GFALFS_CHECKSUM_ADLER32:
+			return "adler32";
+		case GFALFS_CHECKSUM_CRC32C:
+			return "crc32c";
+		case GFALFS_CHECKSUM_MD5:
+			return "md5";
+		default:
+			return "none";
+	}
+}
+
+gfalfs_checksum gfalfs_checksum_new(gfalfs_checksum_type type){
+	gfalfs_checksum res = g_new0(struct _gfalfs_checksum, 1);
+	res->type = type;
+	res->value = (type == GFALFS_CHECKSUM_ADLER32)?1:0;
+	if(type == GFALFS_CHECKSUM_MD5)
+		res->md5 = g_checksum_new(G_CHECKSUM_MD5);
+	return res;
+}
+
+void gfalfs_checksum_update(gfalfs_checksum checksum, const char* buf, size_t len){
+	switch(checksum->type){
+		case GFALFS_CHECKSUM_ADLER32:
+			checksum->value = gfalfs_adler32(checksum->value, (const unsigned char*) buf, len);
+			break;
+		case GFALFS_CHECKSUM_CRC32C:
+			checksum->value = gfalfs_crc32c(checksum->value, (const unsigned char*) buf, len);
+			break;
+		case GFALFS_CHECKSUM_MD5:
+			g_checksum_update(checksum->md5, (const guchar*) buf, len);
+			break;
+		default:
+			break;
+	}
+}
+
+void gfalfs_checksum_get_string(gfalfs_checksum checksum, char* buff, size_t s_buff){
+	if(checksum->type == GFALFS_CHECKSUM_MD5)
+		g_strlcpy(buff, g_checksum_get_string(checksum->md5), s_buff);
+	else
+		g_snprintf(buff, s_buff, "%08x", checksum->value);
+}
+
+void gfalfs_checksum_delete(gfalfs_checksum checksum){
+	if(checksum){
+		if(checksum->md5)
+			g_checksum_free(checksum->md5);
+		g_free(checksum);
+	}
+}
+
+// number of hex digits of a checksum value
+static size_t gfalfs_checksum_type_digits(gfalfs_checksum_type type){
+	switch(type){
+		case GFALFS_CHECKSUM_ADLER32:
+		case GFALFS_CHECKSUM_CRC32C:
+			return 8;
+		case GFALFS_CHECKSUM_MD5:
+			return 32;
+		default:
+			return 0;
+	}
+}
+
+int gfalfs_checksum_remote(const char* url, gfalfs_checksum_type type, char* buff, size_t s_buff){
+	char err_buff[1024];
+	char value[GFALFS_CHECKSUM_MAX_LEN*2];
+	ssize_t ret = gfalfs_timed_getxattr(url, GFALFS_XATTR_CHECKSUM, value, sizeof(value)-1, err_buff, 1024);
+	if(ret < 0){
+		if(ret != -(ENOATTR) && ret != -(EPROTONOSUPPORT))
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_checksum err %d for path %s: %s ", (int) -ret, (char*) url, (char*) err_buff);
+		return -(ENOTSUP);
+	}
+	value[MIN((size_t) ret, sizeof(value)-1)] = '\0';
+	g_strstrip(value);
+	// "type:value", "type value" or only the value
+	char* sep = strpbrk(value, ": ");
+	char* sum = value;
+	if(sep != NULL){
+		*sep = '\0';
+		if(gfalfs_checksum_type_from_name(value) != type)
+			return -(ENOTSUP);
+		sum = sep + 1;
+	}else{
+		// untyped value : md5 is the only type with 32 digits, the 8 digits of adler32 and crc32c
+		// can not be told apart, their type has to be given by checksum_untyped, else nothing is verified
+		const size_t digits = strspn(sum, "0123456789abcdefABCDEF");
+		if(sum[digits] != '\0' || digits != gfalfs_checksum_type_digits(type))
+			return -(ENOTSUP);
+		if(type != GFALFS_CHECKSUM_MD5 && type != (gfalfs_checksum_type) gfalfs_get_checksum_untyped())
+			return -(ENOTSUP);
+	}
+	if(*sum == '\0')
+		return -(ENOTSUP);
+	g_strlcpy(buff, sum, s_buff);
+	return 0;
+}
+
+gboolean gfalfs_checksum_equal(const char* a, const char* b){
+	while(*a == '0')
+		++a;
+	while(*b == '0')
+		++b;
+	return g_ascii_strcasecmp(a, b) == 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_checksum.h
+ * @brief incremental checksums used to verify the transfered content
+ */
+
+#include <stddef.h>
+#include <glib.h>
+
+#define GFALFS_CHECKSUM_MAX_LEN 64
+
+typedef enum{
+	GFALFS_CHECKSUM_NONE=0,
+	GFALFS_CHECKSUM_ADLER32,
+	GFALFS_CHECKSUM_CRC32C,
+	GFALFS_CHECKSUM_MD5
+} gfalfs_checksum_type;
+
+typedef struct _gfalfs_checksum{
+	gfalfs_checksum_type type;
+	guint32 value; // adler32 and crc32c state
+	GChecksum* md5;
+} *gfalfs_checksum;
+
+
+gfalfs_checksum_type gfalfs_checksum_type_from_name(const char* name);
+
+const char* gfalfs_checksum_type_name(gfalfs_checksum_type type);
+
+gfalfs_checksum gfalfs_checksum_new(gfalfs_checksum_type type);
+
+void gfalfs_checksum_update(gfalfs_checksum checksum, const char* buf, size_t len);
+
+// write the lower case hexadecimal value of the checksum
+void gfalfs_checksum_get_string(gfalfs_checksum checksum, char* buff, size_t s_buff);
+
+void gfalfs_checksum_delete(gfalfs_checksum checksum);
+
+// get the checksum stored by the storage for url with the user.checksum attribute
+// return -(ENOTSUP) if the storage gives no value of this type, or an untyped value of an unknown type
+int gfalfs_checksum_remote(const char* url, gfalfs_checksum_type type, char* buff, size_t s_buff);
+
+// compare two hexadecimal checksums, ignore the case and the leading zeros
+gboolean gfalfs_checksum_equal(const char* a, const char* b);
+
+guint32 gfalfs_adler32(guint32 adler, const unsigned char* buf, size_t len);
+
+guint32 gfalfs_crc32c(guint32 crc, const unsigned char* buf, size_t len);
@@ -0,0 +1,219 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+
+/*
+ * gfal_control.c
+ * control attributes, set on a path :
+ *  user.gfalfs.crawl : fill the metadata cache with the tree of a directory
+ *  user.gfalfs.prefetch : load a file, or the files of a directory, in the block cache
+ *  user.gfalfs.pin : "1" keeps the cached blocks of a file out of the eviction, "0" releases them
+ *  user.gfalfs.evict : forget the cached metadata and blocks of a path and of its content
+ *  user.gfalfs.flush : upload now the staged content of a file
+ *  user.gfalfs.rmtree : delete a directory and its content in background, with bulk unlinks
+ *  user.gfalfs.copy : copy a file or a tree in background to the url or local path of the value
+ * and read on a path :
+ *  user.gfalfs.crawl, user.gfalfs.prefetch : pending tasks
+ *  user.gfalfs.rmtree, user.gfalfs.copy : pending and failed tree tasks
+ *  user.gfalfs.pin : pin status of a file
+ *  user.gfalfs.cache : cached blocks of a file
+ *  user.gfalfs.stats : transfers through the handles of a file
+ *  user.gfalfs.global : statistics of the whole file system
+ * */
+
+#include <errno.h>
+#include <string.h>
+
+#include <gfal_api.h>
+
+#include "gfal_control.h"
+#include "gfal_blockcache.h"
+#include "gfal_bufpool.h"
+#include "gfal_bulk.h"
+#include "gfal_cache.h"
+#include "gfal_crawler.h"
+#include "gfal_deadline.h"
+#include "gfal_readahead.h"
+#include "gfal_staging.h"
+
+#define GFALFS_XATTR_CRAWL GFALFS_XATTR_PREFIX "crawl"
+#define GFALFS_XATTR_PREFETCH GFALFS_XATTR_PREFIX "prefetch"
+#define GFALFS_XATTR_PIN GFALFS_XATTR_PREFIX "pin"
+#define GFALFS_XATTR_EVICT GFALFS_XATTR_PREFIX "evict"
+#define GFALFS_XATTR_FLUSH GFALFS_XATTR_PREFIX "flush"
+#define GFALFS_XATTR_RMTREE GFALFS_XATTR_PREFIX "rmtree"
+#define GFALFS_XATTR_COPY GFALFS_XATTR_PREFIX "copy"
+#define GFALFS_XATTR_CACHE GFALFS_XATTR_PREFIX "cache"
+#define GFALFS_XATTR_STATS GFALFS_XATTR_PREFIX "stats"
+#define GFALFS_XATTR_GLOBAL GFALFS_XATTR_PREFIX "global"
+
+#define GFALFS_XATTR_VALUE_MAX_LEN 1024
+
+typedef struct _gfalfs_file_stats{
+	guint64 opens;
+	guint64 bytes_read;
+	guint64 bytes_written;
+	guint64 reads;
+	guint64 cache_hits;
+	guint64 remote_reads;
+	gint64 transfer_usec;
+} gfalfs_file_stats;
+
+// statistics of the released handles by local path
+static GStaticMutex stats_mutex = G_STATIC_MUTEX_INIT;
+static GHashTable* stats_table = NULL;
+
+
+gboolean gfalfs_control_is_xattr(const char* name){
+	return strncmp(name, GFALFS_XATTR_PREFIX, strlen(GFALFS_XATTR_PREFIX)) == 0;
+}
+
+void gfalfs_control_account(gfalFS_file_handle handle){
+	g_static_mutex_lock(&stats_mutex);
+	if(stats_table == NULL)
+		stats_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	gfalfs_file_stats* stats = g_hash_table_lookup(stats_table, handle->local_path);
+	if(stats == NULL){
+		if(g_hash_table_size(stats_table) >= gfalfs_get_md_cache_size())
+			g_hash_table_remove_all(stats_table);
+		stats = g_new0(gfalfs_file_stats, 1);
+		g_hash_table_insert(stats_table, g_strdup(handle->local_path), stats);
+	}
+	stats->opens += 1;
+	stats->bytes_read += handle->bytes_read;
+	stats->bytes_written += handle->bytes_written;
+	stats->reads += handle->pattern.reads;
+	stats->cache_hits += handle->pattern.cache_hits;
+	stats->remote_reads += handle->pattern.remote_reads;
+	stats->transfer_usec += handle->transfer_usec;
+	g_static_mutex_unlock(&stats_mutex);
+}
+
+static void gfalfs_control_file_stats(const char* path, char* value, size_t s_value){
+	gfalfs_file_stats stats;
+	memset(&stats, 0, sizeof(gfalfs_file_stats));
+	g_static_mutex_lock(&stats_mutex);
+	gfalfs_file_stats* res = (stats_table)?g_hash_table_lookup(stats_table, path):NULL;
+	if(res != NULL)
+		stats = *res;
+	g_static_mutex_unlock(&stats_mutex);
+	g_snprintf(value, s_value, "opens=%lu bytes_read=%lu bytes_written=%lu reads=%lu cache_hits=%lu remote_reads=%lu transfer_ms=%ld",
+				(unsigned long) stats.opens, (unsigned long) stats.bytes_read, (unsigned long) stats.bytes_written,
+				(unsigned long) stats.reads, (unsigned long) stats.cache_hits, (unsigned long) stats.remote_reads,
+				(long) (stats.transfer_usec / 1000));
+}
+
+static void gfalfs_control_file_cache(const char* path, char* value, size_t s_value){
+	guint64 blocks, bytes;
+	gboolean pinned;
+	struct stat st;
+	gfalfs_blockcache_get_file_usage(gfalfs_path_ino(path), &blocks, &bytes, &pinned);
+	const long size = (gfalfs_cache_peek_stat(path, &st))?(long) st.st_size:-1;
+	g_snprintf(value, s_value, "blocks=%lu bytes=%lu size=%ld pinned=%d",
+				(unsigned long) blocks, (unsigned long) bytes, size, (int) pinned);
+}
+
+static void gfalfs_control_global_stats(char* value, size_t s_value){
+	guint64 reads, cache_hits, remote_reads, prefetched, prefetch_hits, cache_used, cache_pinned;
+	guint64 buf_in_use, buf_idle, buf_waits, recoveries, failures, timeouts, interrupts;
+	guint64 ns_queued, ns_failures, tree_pending, tree_failures;
+	gfalfs_readahead_get_stats(&reads, &cache_hits, &remote_reads);
+	gfalfs_blockcache_get_stats(&prefetched, &prefetch_hits);
+	gfalfs_blockcache_get_usage(&cache_used, &cache_pinned);
+	gfalfs_bufpool_get_stats(&buf_in_use, &buf_idle, &buf_waits);
+	gfalfs_recovery_get_stats(&recoveries, &failures);
+	gfalfs_deadline_get_stats(&timeouts, &interrupts);
+	gfalfs_bulk_get_stats(&ns_queued, &ns_failures, &tree_pending, &tree_failures);
+	g_snprintf(value, s_value, "reads=%lu cache_hits=%lu remote_reads=%lu prefetched=%lu prefetch_hits=%lu"
+				" cache_used=%lu cache_pinned=%lu buffers_used=%lu buffers_idle=%lu buffer_waits=%lu"
+				" recoveries=%lu recovery_failures=%lu timeouts=%lu interrupts=%lu unlinks_queued=%lu unlink_failures=%lu"
+				" tree_pending=%lu tree_failures=%lu crawl_pending=%u prefetch_pending=%u",
+				(unsigned long) reads, (unsigned long) cache_hits, (unsigned long) remote_reads,
+				(unsigned long) prefetched, (unsigned long) prefetch_hits,
+				(unsigned long) cache_used, (unsigned long) cache_pinned,
+				(unsigned long) buf_in_use, (unsigned long) buf_idle, (unsigned long) buf_waits,
+				(unsigned long) recoveries, (unsigned long) failures,
+				(unsigned long) timeouts, (unsigned long) interrupts,
+				(unsigned long) ns_queued, (unsigned long) ns_failures,
+				(unsigned long) tree_pending, (unsigned long) tree_failures,
+				gfalfs_crawler_pending(), gfalfs_readahead_prefetch_pending());
+}
+
+int gfalfs_control_getxattr(const char* path, const char* name, char* buff, size_t s_buff){
+	char value[GFALFS_XATTR_VALUE_MAX_LEN];
+	if(strcmp(name, GFALFS_XATTR_CRAWL) == 0){
+		g_snprintf(value, GFALFS_XATTR_VALUE_MAX_LEN, "%u", gfalfs_crawler_pending());
+	}else if(strcmp(name, GFALFS_XATTR_PREFETCH) == 0){
+		g_snprintf(value, GFALFS_XATTR_VALUE_MAX_LEN, "%u", gfalfs_readahead_prefetch_pending());
+	}else if(strcmp(name, GFALFS_XATTR_RMTREE) == 0 || strcmp(name, GFALFS_XATTR_COPY) == 0){
+		guint64 ns_queued, ns_failures, tree_pending, tree_failures;
+		gfalfs_bulk_get_stats(&ns_queued, &ns_failures, &tree_pending, &tree_failures);
+		g_snprintf(value, GFALFS_XATTR_VALUE_MAX_LEN, "pending=%lu failures=%lu", (unsigned long) tree_pending, (unsigned long) tree_failures);
+	}else if(strcmp(name, GFALFS_XATTR_PIN) == 0){
+		guint64 blocks, bytes;
+		gboolean pinned;
+		gfalfs_blockcache_get_file_usage(gfalfs_path_ino(path), &blocks, &bytes, &pinned);
+		g_snprintf(value, GFALFS_XATTR_VALUE_MAX_LEN, "%d", (int) pinned);
+	}else if(strcmp(name, GFALFS_XATTR_CACHE) == 0){
+		gfalfs_control_file_cache(path, value, GFALFS_XATTR_VALUE_MAX_LEN);
+	}else if(strcmp(name, GFALFS_XATTR_STATS) == 0){
+		gfalfs_control_file_stats(path, value, GFALFS_XATTR_VALUE_MAX_LEN);
+	}else if(strcmp(name, GFALFS_XATTR_GLOBAL) == 0){
+		gfalfs_control_global_stats(value, GFALFS_XATTR_VALUE_MAX_LEN);
+	}else{
+		return -(ENOATTR);
+	}
+	const size_t s_value = strlen(value);
+	if(s_buff == 0)
+		return s_value;
+	if(s_buff < s_value)
+		return -(ERANGE);
+	memcpy(buff, value, s_value);
+	return s_value;
+}
+
+int gfalfs_control_setxattr(const char* path, const char* name, const char* value, size_t s_value){
+	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_control %s on %s", (char*) name, (char*) path);
+	if(strcmp(name, GFALFS_XATTR_CRAWL) == 0)
+		return gfalfs_crawler_start(path);
+	if(strcmp(name, GFALFS_XATTR_PREFETCH) == 0)
+		return gfalfs_readahead_prefetch_path(path);
+	if(strcmp(name, GFALFS_XATTR_PIN) == 0){
+		if(gfalfs_get_readahead_mode() == FALSE)
+			return -(ENOTSUP);
+		gfalfs_blockcache_set_pinned(gfalfs_path_ino(path), !(s_value > 0 && value[0] == '0'));
+		return 0;
+	}
+	if(strcmp(name, GFALFS_XATTR_EVICT) == 0){
+		gfalfs_blockcache_set_pinned(gfalfs_path_ino(path), FALSE);
+		gfalfs_cache_invalidate_tree(path);
+		return 0;
+	}
+	if(strcmp(name, GFALFS_XATTR_FLUSH) == 0){
+		const int ret = gfalfs_staging_upload_path(path);
+		return (ret == -(ENOENT))?0:ret; // nothing staged, nothing to flush
+	}
+	if(strcmp(name, GFALFS_XATTR_RMTREE) == 0)
+		return gfalfs_bulk_rmtree(path);
+	if(strcmp(name, GFALFS_XATTR_COPY) == 0){
+		char dest[GFALFS_XATTR_VALUE_MAX_LEN];
+		if(s_value == 0 || s_value >= GFALFS_XATTR_VALUE_MAX_LEN)
+			return -(EINVAL);
+		memcpy(dest, value, s_value);
+		dest[s_value] = '\0';
+		return gfalfs_bulk_copy(path, g_strstrip(dest));
+	}
+	return -(ENOTSUP);
+}
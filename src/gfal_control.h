@@ -0,0 +1,37 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_control.h
+ * @brief virtual extended attributes "user.gfalfs.*" to control the caches
+ * and to read the statistics of gfalFS, never forwarded to the storage
+ */
+
+#include <glib.h>
+
+#include "gfal_ext.h"
+
+#define GFALFS_XATTR_PREFIX "user.gfalfs."
+
+// TRUE if name is a control attribute of gfalFS
+gboolean gfalfs_control_is_xattr(const char* name);
+
+int gfalfs_control_getxattr(const char* path, const char* name, char* buff, size_t s_buff);
+
+int gfalfs_control_setxattr(const char* path, const char* name, const char* value, size_t s_value);
+
+// account the transfers of a released handle in the statistics of its path
+void gfalfs_control_account(gfalFS_file_handle handle);
@@ -0,0 +1,159 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * gfal_crawler.c
+ * background crawler, walk a directory tree breadth first with a bounded
+ * number of threads and fill the attribute and listing caches
+ * */
+
+#include <errno.h>
+#include <string.h>
+
+#include <gfal_api.h>
+
+#include "gfal_crawler.h"
+#include "gfal_ext.h"
+#include "gfal_deadline.h"
+
+typedef struct _gfalfs_crawl_task{
+	char* path; // local path
+	gboolean is_dir; // list the directory, else only stat the path
+} gfalfs_crawl_task;
+
+// pending tasks beyond which the new entries are not crawled
+#define GFALFS_CRAWLER_MAX_PENDING (1 << 16)
+
+static GStaticMutex crawler_mutex = G_STATIC_MUTEX_INIT;
+static GThreadPool* crawler_pool = NULL;
+static volatile gint crawler_pending = 0;
+static volatile gint crawler_dropped = 0;
+
+
+static void gfalfs_crawler_push(const char* path, gboolean is_dir);
+
+static char* gfalfs_crawler_child_path(const char* dir_path, const char* name){
+	if(strcmp(dir_path, "/") == 0)
+		return g_strconcat("/", name, NULL);
+	return g_strconcat(dir_path, "/", name, NULL);
+}
+
+static void gfalfs_crawler_stat(const char* path, const char* url){
+	struct stat st;
+	if(gfal_lstat(url, &st) == 0){
+		gfalfs_record_stat(path, url, &st);
+	}else{
+		gfal_posix_clear_error();
+	}
+}
+
+static void gfalfs_crawler_list(const char* path, const char* url){
+	char err_buff[1024];
+	gfalfs_listing listing = gfalfs_cache_get_listing(path);
+	guint i;
+	if(listing != NULL){ // already fresh, only the next level is crawled
+		for(i = 0; i < listing->n_entries; ++i){
+			char* child = gfalfs_crawler_child_path(path, listing->entries[i].name);
+			gfalfs_crawler_push(child, listing->entries[i].d_type == DT_DIR);
+			g_free(child);
+		}
+		gfalfs_listing_unref(listing);
+		return;
+	}
+
+	const guint64 generation = gfalfs_cache_generation();
+	DIR* d = gfal_opendir(url);
+	if(d == NULL){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_crawler opendir err %d for path %s: %s", (int)gfal_posix_code_error(), (char*) url, (char*) gfal_posix_strerror_r(err_buff, 1024));
+		gfal_posix_clear_error();
+		return;
+	}
+	GArray* entries = g_array_new(FALSE, FALSE, sizeof(gfalfs_listing_entry));
+	struct dirent* dir;
+	while( (dir = gfal_readdir(d)) != NULL){
+		if(strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
+			continue;
+		gfalfs_listing_entry entry = { g_strdup(dir->d_name), dir->d_type };
+		g_array_append_val(entries, entry);
+	}
+	const int errcode = gfal_posix_code_error();
+	gfal_posix_clear_error();
+	gfal_closedir(d);
+	gfal_posix_clear_error();
+
+	listing = gfalfs_listing_new(entries);
+	if(errcode == 0){
+		for(i = 0; i < listing->n_entries; ++i){
+			char* child = gfalfs_crawler_child_path(path, listing->entries[i].name);
+			gfalfs_crawler_push(child, listing->entries[i].d_type == DT_DIR);
+			g_free(child);
+		}
+		gfalfs_cache_set_listing(path, listing, generation);
+	}else{
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_crawler readdir err %d for path %s", errcode, (char*) url);
+		gfalfs_listing_unref(listing);
+	}
+}
+
+static void gfalfs_crawler_worker(gpointer data, gpointer user_data){
+	gfalfs_crawl_task* task = (gfalfs_crawl_task*) data;
+	char url[GFALFS_URL_MAX_LEN];
+	gfalfs_deadline_background_thread();
+	gfalfs_construct_path(task->path, url, GFALFS_URL_MAX_LEN);
+
+	gfalfs_crawler_stat(task->path, url);
+	if(task->is_dir)
+		gfalfs_crawler_list(task->path, url);
+
+	g_atomic_int_add(&crawler_pending, -1);
+	g_free(task->path);
+	g_free(task);
+}
+
+static void gfalfs_crawler_push(const char* path, gboolean is_dir){
+	if(g_atomic_int_exchange_and_add(&crawler_pending, 1) >= GFALFS_CRAWLER_MAX_PENDING){ // queue full, the entry stays uncached
+		g_atomic_int_add(&crawler_pending, -1);
+		if(g_atomic_int_exchange_and_add(&crawler_dropped, 1) == 0 || is_dir)
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_crawler queue full, %s not crawled", (char*) path);
+		return;
+	}
+	gfalfs_crawl_task* task = g_new0(gfalfs_crawl_task, 1);
+	task->path = g_strdup(path);
+	task->is_dir = is_dir;
+	g_thread_pool_push(crawler_pool, task, NULL);
+}
+
+int gfalfs_crawler_start(const char* dir_path){
+	GError* tmp_err = NULL;
+	if(gfalfs_get_md_cache_ttl() == 0) // nothing to fill
+		return -(ENOTSUP);
+
+	g_static_mutex_lock(&crawler_mutex);
+	if(crawler_pool == NULL)
+		crawler_pool = g_thread_pool_new(gfalfs_crawler_worker, NULL, (gint) gfalfs_get_crawl_threads(), FALSE, &tmp_err);
+	g_static_mutex_unlock(&crawler_mutex);
+	if(crawler_pool == NULL){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_crawler err : %s", tmp_err->message);
+		g_error_free(tmp_err);
+		return -(EAGAIN);
+	}
+	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_crawler start for %s", (char*) dir_path);
+	gfalfs_crawler_push(dir_path, TRUE);
+	return 0;
+}
+
+guint gfalfs_crawler_pending(){
+	return (guint) g_atomic_int_get(&crawler_pending);
+}
@@ -0,0 +1,28 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_crawler.h
+ * @brief background crawler, fill the metadata cache of a directory tree
+ */
+
+#include <glib.h>
+
+// crawl the tree under the local path dir_path in the background
+int gfalfs_crawler_start(const char* dir_path);
+
+// number of crawl tasks still pending
+guint gfalfs_crawler_pending();
@@ -0,0 +1,636 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+
+/*
+ * gfal_deadline.c
+ * execution of the gfal2 calls with a deadline
+ *
+ * the gfal2 POSIX API gives no access to the context of its calls, they can not
+ * be cancelled : an abandoned call keeps its worker until gfal2 returns, then
+ * its result is discarded and its resources released. The workers are bounded
+ * by op_threads, the calls queued beyond wait within their own deadline, a call
+ * abandoned before a worker takes it is not executed. The close of a descriptor
+ * is deferred until the last abandoned read or write on it returns
+ * */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gfal_api.h>
+
+#include "gfal_deadline.h"
+#include "gfal_bufpool.h"
+#include "gfal_opers.h"
+#include "params.h"
+
+// period of the interruption checks, in micro-seconds
+#define GFALFS_DEADLINE_CHECK_PERIOD 100000
+#define GFALFS_DEADLINE_ERR_LEN 1024
+
+typedef enum{
+	GFALFS_CALL_LSTAT,
+	GFALFS_CALL_OPEN,
+	GFALFS_CALL_OPENDIR,
+	GFALFS_CALL_PREAD,
+	GFALFS_CALL_PWRITE,
+	GFALFS_CALL_UNLINK,
+	GFALFS_CALL_MKDIR,
+	GFALFS_CALL_RMDIR,
+	GFALFS_CALL_RENAME,
+	GFALFS_CALL_READLINK,
+	GFALFS_CALL_ACCESS,
+	GFALFS_CALL_CHMOD,
+	GFALFS_CALL_GETXATTR,
+	GFALFS_CALL_SETXATTR,
+	GFALFS_CALL_LISTXATTR,
+	GFALFS_CALL_CREAT,
+	GFALFS_CALL_SYMLINK,
+	GFALFS_CALL_CLOSE,
+	GFALFS_CALL_READDIR,
+	GFALFS_CALL_CLOSEDIR
+} gfalfs_call_type;
+
+// arguments and results of a call, owned by the call once it runs in a worker
+typedef struct _gfalfs_call_data{
+	gfalfs_call_type type;
+	char* url;
+	char* url2;
+	char* name; // attribute name
+	char* value; // own copy of the link, attribute or list buffer
+	size_t s_value;
+	int fd; // argument of pread/pwrite/close, result of open and creat
+	int flags;
+	mode_t mode;
+	char* buffer;
+	gboolean own_buffer; // buffer allocated from the pool
+	size_t size;
+	off_t offset;
+	struct stat st;
+	DIR* dir; // result of opendir
+	DIR* dir_arg; // argument of readdir and closedir
+	struct dirent entry; // result of readdir
+	char err_buff[GFALFS_DEADLINE_ERR_LEN];
+} gfalfs_call_data;
+
+typedef struct _gfalfs_call{
+	gint ref; // caller and worker
+	GMutex* mut;
+	GCond* cond;
+	gboolean done;
+	gboolean abandoned;
+	gfalfs_call_data* data;
+	ssize_t res;
+} gfalfs_call;
+
+typedef struct _gfalfs_fd_users{
+	guint calls; // reads and writes, or readdirs, queued or running in a worker
+	gboolean closing; // closed while in use
+} gfalfs_fd_users;
+
+static GStaticMutex deadline_mutex = G_STATIC_MUTEX_INIT;
+static GThreadPool* deadline_pool = NULL;
+// descriptors and directories used by the workers, protected by deadline_mutex
+static GHashTable* fd_table = NULL;
+static GHashTable* dir_table = NULL;
+static volatile gint stat_timeouts = 0;
+static volatile gint stat_interrupts = 0;
+
+static GStaticPrivate background_key = G_STATIC_PRIVATE_INIT;
+
+
+void gfalfs_deadline_background_thread(){
+	g_static_private_set(&background_key, GINT_TO_POINTER(1), NULL);
+}
+
+gboolean gfalfs_deadline_interrupted(){
+	return g_static_private_get(&background_key) == NULL && fuse_interrupted();
+}
+
+static guint64 gfalfs_deadline_timeout(gfalfs_op_class klass){
+	switch(klass){
+		case GFALFS_OP_METADATA:
+			return gfalfs_get_md_timeout();
+		case GFALFS_OP_NAMESPACE:
+			return gfalfs_get_ns_timeout();
+		default:
+			return gfalfs_get_io_timeout();
+	}
+}
+
+static gfalfs_call_data* gfalfs_call_data_new(gfalfs_call_type type, const char* url){
+	gfalfs_call_data* data = g_new0(gfalfs_call_data, 1);
+	data->type = type;
+	data->url = (url)?g_strdup(url):NULL;
+	data->fd = -1;
+	return data;
+}
+
+// release a call, and the descriptors opened by an abandoned one
+static void gfalfs_call_data_delete(gfalfs_call_data* data){
+	if((data->type == GFALFS_CALL_OPEN || data->type == GFALFS_CALL_CREAT) && data->fd >= 0)
+		gfal_close(data->fd);
+	if(data->dir != NULL)
+		gfal_closedir(data->dir);
+	gfal_posix_clear_error();
+	if(data->own_buffer)
+		gfalfs_buffer_free(data->buffer);
+	g_free(data->url);
+	g_free(data->url2);
+	g_free(data->name);
+	g_free(data->value);
+	g_free(data);
+}
+
+static ssize_t gfalfs_call_exec(gfalfs_call_data* data){
+	ssize_t res = 0;
+	switch(data->type){
+		case GFALFS_CALL_LSTAT:
+			res = gfal_lstat(data->url, &(data->st));
+			break;
+		case GFALFS_CALL_OPEN:
+			res = data->fd = gfal_open(data->url, data->flags, data->mode);
+			break;
+		case GFALFS_CALL_OPENDIR:
+			data->dir = gfal_opendir(data->url);
+			res = (data->dir)?0:-1;
+			break;
+		case GFALFS_CALL_PREAD:
+			res = gfal_pread(data->fd, data->buffer, data->size, data->offset);
+			break;
+		case GFALFS_CALL_PWRITE:
+			res = gfal_pwrite(data->fd, data->buffer, data->size, data->offset);
+			break;
+		case GFALFS_CALL_UNLINK:
+			res = gfal_unlink(data->url);
+			break;
+		case GFALFS_CALL_MKDIR:
+			res = gfal_mkdir(data->url, data->mode);
+			break;
+		case GFALFS_CALL_RMDIR:
+			res = gfal_rmdir(data->url);
+			break;
+		case GFALFS_CALL_RENAME:
+			res = gfal_rename(data->url, data->url2);
+			break;
+		case GFALFS_CALL_READLINK:
+			res = gfal_readlink(data->url, data->value, data->s_value);
+			break;
+		case GFALFS_CALL_ACCESS:
+			res = gfal_access(data->url, data->flags);
+			break;
+		case GFALFS_CALL_CHMOD:
+			res = gfal_chmod(data->url, data->mode);
+			break;
+		case GFALFS_CALL_GETXATTR:
+			res = gfal_getxattr(data->url, data->name, data->value, data->s_value);
+			break;
+		case GFALFS_CALL_SETXATTR:
+			res = gfal_setxattr(data->url, data->name, data->value, data->s_value, data->flags);
+			break;
+		case GFALFS_CALL_LISTXATTR:
+			res = gfal_listxattr(data->url, data->value, data->s_value);
+			break;
+		case GFALFS_CALL_CREAT:
+			res = data->fd = gfal_creat(data->url, data->mode);
+			break;
+		case GFALFS_CALL_SYMLINK:
+			res = gfal_symlink(data->url, data->url2);
+			break;
+		case GFALFS_CALL_CLOSE:
+			res = gfal_close(data->fd);
+			break;
+		case GFALFS_CALL_READDIR:{
+			struct dirent* entry = gfal_readdir(data->dir_arg);
+			if(entry != NULL){
+				memcpy(&(data->entry), entry, sizeof(struct dirent));
+				res = 1;
+			}else{ // end of the directory or error
+				res = (gfal_posix_code_error() != 0)?-1:0;
+			}
+			break;
+		}
+		case GFALFS_CALL_CLOSEDIR:
+			res = gfal_closedir(data->dir_arg);
+			break;
+	}
+	if(res < 0){
+		gfal_posix_strerror_r(data->err_buff, GFALFS_DEADLINE_ERR_LEN);
+		res = -(gfal_posix_code_error());
+		if(res == 0)
+			res = -(EIO);
+		data->fd = -1;
+	}
+	gfal_posix_clear_error();
+	return res;
+}
+
+static const char* gfalfs_call_target(gfalfs_call_data* data){
+	return (data->url)?data->url:"file descriptor";
+}
+
+static void gfalfs_call_unref(gfalfs_call* call){
+	if(g_atomic_int_dec_and_test(&(call->ref))){
+		g_cond_free(call->cond);
+		g_mutex_free(call->mut);
+		g_free(call);
+	}
+}
+
+// descriptor of a read or a write, -1 for the other calls
+static int gfalfs_call_fd(gfalfs_call_data* data){
+	return (data->type == GFALFS_CALL_PREAD || data->type == GFALFS_CALL_PWRITE)?data->fd:-1;
+}
+
+// directory of a readdir, NULL for the other calls
+static DIR* gfalfs_call_dir(gfalfs_call_data* data){
+	return (data->type == GFALFS_CALL_READDIR)?data->dir_arg:NULL;
+}
+
+static void gfalfs_deadline_users_acquire(GHashTable** table, gpointer key){
+	g_static_mutex_lock(&deadline_mutex);
+	if(*table == NULL)
+		*table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+	gfalfs_fd_users* users = g_hash_table_lookup(*table, key);
+	if(users == NULL){
+		users = g_new0(gfalfs_fd_users, 1);
+		g_hash_table_insert(*table, key, users);
+	}
+	users->calls += 1;
+	g_static_mutex_unlock(&deadline_mutex);
+}
+
+// TRUE for the last call on a closed descriptor or directory, the caller closes it
+static gboolean gfalfs_deadline_users_release(GHashTable* table, gpointer key){
+	g_static_mutex_lock(&deadline_mutex);
+	gfalfs_fd_users* users = g_hash_table_lookup(table, key);
+	const gboolean last = (--(users->calls) == 0);
+	const gboolean closing = users->closing;
+	if(last)
+		g_hash_table_remove(table, key);
+	g_static_mutex_unlock(&deadline_mutex);
+	return last && closing;
+}
+
+// TRUE if the descriptor or directory is in use, it is closed by its last call
+static gboolean gfalfs_deadline_users_close(GHashTable* table, gpointer key){
+	g_static_mutex_lock(&deadline_mutex);
+	gfalfs_fd_users* users = (table)?g_hash_table_lookup(table, key):NULL;
+	if(users != NULL)
+		users->closing = TRUE;
+	g_static_mutex_unlock(&deadline_mutex);
+	return users != NULL;
+}
+
+// release the descriptor or the directory used by a call, close it after a deferred close
+static void gfalfs_deadline_users_put(int fd, DIR* dir){
+	char err_buff[GFALFS_DEADLINE_ERR_LEN];
+	if(fd >= 0 && gfalfs_deadline_users_release(fd_table, GINT_TO_POINTER(fd))){
+		if(gfal_close(fd) < 0)
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_deadline deferred close err %d for fd %d: %s ", (int) gfal_posix_code_error(), fd, (char*) gfal_posix_strerror_r(err_buff, GFALFS_DEADLINE_ERR_LEN));
+		gfal_posix_clear_error();
+	}
+	if(dir != NULL && gfalfs_deadline_users_release(dir_table, dir)){
+		if(gfal_closedir(dir) < 0)
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_deadline deferred closedir err %d: %s ", (int) gfal_posix_code_error(), (char*) gfal_posix_strerror_r(err_buff, GFALFS_DEADLINE_ERR_LEN));
+		gfal_posix_clear_error();
+	}
+}
+
+static void gfalfs_deadline_worker(gpointer d, gpointer user_data){
+	gfalfs_call* call = (gfalfs_call*) d;
+	const int fd = gfalfs_call_fd(call->data);
+	DIR* dir = gfalfs_call_dir(call->data);
+	gfalfs_deadline_background_thread();
+	g_mutex_lock(call->mut);
+	const gboolean skipped = call->abandoned; // abandoned while queued
+	g_mutex_unlock(call->mut);
+	const ssize_t res = (skipped)?-(ECANCELED):gfalfs_call_exec(call->data);
+	g_mutex_lock(call->mut);
+	call->res = res;
+	call->done = TRUE;
+	const gboolean abandoned = call->abandoned;
+	g_cond_signal(call->cond);
+	g_mutex_unlock(call->mut);
+	if(abandoned){
+		if(skipped)
+			gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_deadline abandoned call on %s skipped", gfalfs_call_target(call->data));
+		else
+			gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_deadline abandoned call on %s returned %ld", gfalfs_call_target(call->data), (long) res);
+		gfalfs_call_data_delete(call->data);
+	}
+	gfalfs_deadline_users_put(fd, dir);
+	gfalfs_call_unref(call);
+}
+
+// execute a call with the deadline of its class, the data are released by the worker if the call is abandoned
+static ssize_t gfalfs_deadline_run(gfalfs_op_class klass, gfalfs_call_data* data, gboolean* completed){
+	const guint64 timeout = gfalfs_deadline_timeout(klass);
+	ssize_t res;
+	*completed = TRUE;
+	if(timeout == 0)
+		return gfalfs_call_exec(data);
+
+	g_static_mutex_lock(&deadline_mutex);
+	if(deadline_pool == NULL)
+		deadline_pool = g_thread_pool_new(gfalfs_deadline_worker, NULL, (gint) gfalfs_get_op_threads(), FALSE, NULL);
+	g_static_mutex_unlock(&deadline_mutex);
+
+	gfalfs_call* call = g_new0(gfalfs_call, 1);
+	call->ref = 2;
+	call->mut = g_mutex_new();
+	call->cond = g_cond_new();
+	call->data = data;
+	const gint64 deadline = g_get_monotonic_time() + ((gint64) timeout) * G_USEC_PER_SEC;
+	if(gfalfs_call_fd(data) >= 0)
+		gfalfs_deadline_users_acquire(&fd_table, GINT_TO_POINTER(gfalfs_call_fd(data)));
+	if(gfalfs_call_dir(data) != NULL)
+		gfalfs_deadline_users_acquire(&dir_table, gfalfs_call_dir(data));
+	g_thread_pool_push(deadline_pool, call, NULL);
+
+	g_mutex_lock(call->mut);
+	while(call->done == FALSE){
+		GTimeVal tv;
+		g_get_current_time(&tv);
+		g_time_val_add(&tv, GFALFS_DEADLINE_CHECK_PERIOD);
+		g_cond_timed_wait(call->cond, call->mut, &tv);
+		if(call->done)
+			break;
+		if(gfalfs_deadline_interrupted()){
+			g_atomic_int_inc(&stat_interrupts);
+			res = -(ECANCELED);
+			break;
+		}
+		if(g_get_monotonic_time() >= deadline){
+			g_atomic_int_inc(&stat_timeouts);
+			res = -(ETIMEDOUT);
+			break;
+		}
+	}
+	if(call->done){
+		res = call->res;
+	}else{
+		call->abandoned = TRUE;
+		*completed = FALSE;
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_deadline call on %s abandoned, err %d", gfalfs_call_target(data), (int) -res);
+	}
+	g_mutex_unlock(call->mut);
+	gfalfs_call_unref(call);
+	return res;
+}
+
+// execute a call and release its data, unless the worker owns them
+static ssize_t gfalfs_deadline_run_once(gfalfs_op_class klass, gfalfs_call_data* data, char* err_buff, size_t s_err){
+	gboolean completed;
+	const ssize_t res = gfalfs_deadline_run(klass, data, &completed);
+	if(completed){
+		if(res < 0)
+			g_strlcpy(err_buff, data->err_buff, s_err);
+		gfalfs_call_data_delete(data);
+	}else{
+		g_strlcpy(err_buff, strerror(-res), s_err);
+	}
+	return res;
+}
+
+int gfalfs_timed_lstat(const char* url, struct stat* st, char* err_buff, size_t s_err){
+	gboolean completed;
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_LSTAT, url);
+	const int res = gfalfs_deadline_run(GFALFS_OP_METADATA, data, &completed);
+	if(completed){
+		if(res == 0)
+			*st = data->st;
+		else
+			g_strlcpy(err_buff, data->err_buff, s_err);
+		gfalfs_call_data_delete(data);
+	}else{
+		g_strlcpy(err_buff, strerror(-res), s_err);
+	}
+	return res;
+}
+
+// open or creat, the descriptor belongs to the caller once the call completed
+static int gfalfs_deadline_run_open(gfalfs_op_class klass, gfalfs_call_data* data, char* err_buff, size_t s_err){
+	gboolean completed;
+	const int res = gfalfs_deadline_run(klass, data, &completed);
+	if(completed){
+		if(res < 0)
+			g_strlcpy(err_buff, data->err_buff, s_err);
+		data->fd = -1; // the descriptor belongs to the caller
+		gfalfs_call_data_delete(data);
+	}else{
+		g_strlcpy(err_buff, strerror(-res), s_err);
+	}
+	return res;
+}
+
+int gfalfs_timed_open(const char* url, int flags, mode_t mode, char* err_buff, size_t s_err){
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_OPEN, url);
+	data->flags = flags;
+	data->mode = mode;
+	return gfalfs_deadline_run_open(GFALFS_OP_METADATA, data, err_buff, s_err);
+}
+
+int gfalfs_timed_creat(const char* url, mode_t mode, char* err_buff, size_t s_err){
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_CREAT, url);
+	data->mode = mode;
+	return gfalfs_deadline_run_open(GFALFS_OP_NAMESPACE, data, err_buff, s_err);
+}
+
+DIR* gfalfs_timed_opendir(const char* url, int* errcode, char* err_buff, size_t s_err){
+	gboolean completed;
+	DIR* res = NULL;
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_OPENDIR, url);
+	*errcode = -(gfalfs_deadline_run(GFALFS_OP_METADATA, data, &completed));
+	if(completed){
+		if(*errcode != 0)
+			g_strlcpy(err_buff, data->err_buff, s_err);
+		res = data->dir;
+		data->dir = NULL;
+		gfalfs_call_data_delete(data);
+	}else{
+		g_strlcpy(err_buff, strerror(*errcode), s_err);
+	}
+	return res;
+}
+
+ssize_t gfalfs_timed_pread(int fd, char* buf, size_t size, off_t offset, char* err_buff, size_t s_err){
+	gboolean completed;
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_PREAD, NULL);
+	data->fd = fd;
+	data->size = size;
+	data->offset = offset;
+	// an abandoned read must not write in the buffer of the caller
+	data->own_buffer = (gfalfs_deadline_timeout(GFALFS_OP_DATA) > 0);
+	data->buffer = (data->own_buffer)?gfalfs_buffer_alloc(size):buf;
+	if(data->buffer == NULL){
+		gfalfs_call_data_delete(data);
+		g_strlcpy(err_buff, strerror(ENOMEM), s_err);
+		return -(ENOMEM);
+	}
+	const ssize_t res = gfalfs_deadline_run(GFALFS_OP_DATA, data, &completed);
+	if(completed){
+		if(res > 0 && data->own_buffer)
+			memcpy(buf, data->buffer, res);
+		if(res < 0)
+			g_strlcpy(err_buff, data->err_buff, s_err);
+		gfalfs_call_data_delete(data);
+	}else{
+		g_strlcpy(err_buff, strerror(-res), s_err);
+	}
+	return res;
+}
+
+ssize_t gfalfs_timed_pwrite(int fd, const char* buf, size_t size, off_t offset, char* err_buff, size_t s_err){
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_PWRITE, NULL);
+	data->fd = fd;
+	data->size = size;
+	data->offset = offset;
+	data->own_buffer = (gfalfs_deadline_timeout(GFALFS_OP_DATA) > 0);
+	if(data->own_buffer){
+		if( (data->buffer = gfalfs_buffer_alloc(size)) == NULL){
+			gfalfs_call_data_delete(data);
+			g_strlcpy(err_buff, strerror(ENOMEM), s_err);
+			return -(ENOMEM);
+		}
+		memcpy(data->buffer, buf, size);
+	}else{
+		data->buffer = (char*) buf;
+	}
+	return gfalfs_deadline_run_once(GFALFS_OP_DATA, data, err_buff, s_err);
+}
+
+int gfalfs_timed_unlink(const char* url, char* err_buff, size_t s_err){
+	return gfalfs_deadline_run_once(GFALFS_OP_NAMESPACE, gfalfs_call_data_new(GFALFS_CALL_UNLINK, url), err_buff, s_err);
+}
+
+int gfalfs_timed_mkdir(const char* url, mode_t mode, char* err_buff, size_t s_err){
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_MKDIR, url);
+	data->mode = mode;
+	return gfalfs_deadline_run_once(GFALFS_OP_NAMESPACE, data, err_buff, s_err);
+}
+
+int gfalfs_timed_rmdir(const char* url, char* err_buff, size_t s_err){
+	return gfalfs_deadline_run_once(GFALFS_OP_NAMESPACE, gfalfs_call_data_new(GFALFS_CALL_RMDIR, url), err_buff, s_err);
+}
+
+int gfalfs_timed_rename(const char* old_url, const char* new_url, char* err_buff, size_t s_err){
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_RENAME, old_url);
+	data->url2 = g_strdup(new_url);
+	return gfalfs_deadline_run_once(GFALFS_OP_NAMESPACE, data, err_buff, s_err);
+}
+
+// execute a call filling data->value, copied to the buffer of the caller once the call completed
+static ssize_t gfalfs_deadline_run_value(gfalfs_op_class klass, gfalfs_call_data* data, char* buff, size_t s_buff,
+											char* err_buff, size_t s_err){
+	gboolean completed;
+	data->s_value = s_buff;
+	data->value = (s_buff > 0)?g_malloc(s_buff):NULL;
+	const ssize_t res = gfalfs_deadline_run(klass, data, &completed);
+	if(completed){
+		if(res > 0 && s_buff > 0)
+			memcpy(buff, data->value, MIN((size_t) res, s_buff));
+		if(res < 0)
+			g_strlcpy(err_buff, data->err_buff, s_err);
+		gfalfs_call_data_delete(data);
+	}else{
+		g_strlcpy(err_buff, strerror(-res), s_err);
+	}
+	return res;
+}
+
+ssize_t gfalfs_timed_readlink(const char* url, char* buff, size_t s_buff, char* err_buff, size_t s_err){
+	return gfalfs_deadline_run_value(GFALFS_OP_METADATA, gfalfs_call_data_new(GFALFS_CALL_READLINK, url), buff, s_buff, err_buff, s_err);
+}
+
+int gfalfs_timed_access(const char* url, int amode, char* err_buff, size_t s_err){
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_ACCESS, url);
+	data->flags = amode;
+	return gfalfs_deadline_run_once(GFALFS_OP_METADATA, data, err_buff, s_err);
+}
+
+int gfalfs_timed_chmod(const char* url, mode_t mode, char* err_buff, size_t s_err){
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_CHMOD, url);
+	data->mode = mode;
+	return gfalfs_deadline_run_once(GFALFS_OP_NAMESPACE, data, err_buff, s_err);
+}
+
+ssize_t gfalfs_timed_getxattr(const char* url, const char* name, char* buff, size_t s_buff, char* err_buff, size_t s_err){
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_GETXATTR, url);
+	data->name = g_strdup(name);
+	return gfalfs_deadline_run_value(GFALFS_OP_METADATA, data, buff, s_buff, err_buff, s_err);
+}
+
+int gfalfs_timed_setxattr(const char* url, const char* name, const char* value, size_t size, int flags, char* err_buff, size_t s_err){
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_SETXATTR, url);
+	data->name = g_strdup(name);
+	data->value = g_memdup(value, size);
+	data->s_value = size;
+	data->flags = flags;
+	return gfalfs_deadline_run_once(GFALFS_OP_NAMESPACE, data, err_buff, s_err);
+}
+
+ssize_t gfalfs_timed_listxattr(const char* url, char* list, size_t s_list, char* err_buff, size_t s_err){
+	return gfalfs_deadline_run_value(GFALFS_OP_METADATA, gfalfs_call_data_new(GFALFS_CALL_LISTXATTR, url), list, s_list, err_buff, s_err);
+}
+
+int gfalfs_timed_symlink(const char* target, const char* url, char* err_buff, size_t s_err){
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_SYMLINK, target);
+	data->url2 = g_strdup(url);
+	return gfalfs_deadline_run_once(GFALFS_OP_NAMESPACE, data, err_buff, s_err);
+}
+
+int gfalfs_timed_close(int fd, char* err_buff, size_t s_err){
+	if(gfalfs_deadline_users_close(fd_table, GINT_TO_POINTER(fd))){
+		gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_deadline close of fd %d deferred after the abandoned calls", fd);
+		return 0;
+	}
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_CLOSE, NULL);
+	data->fd = fd;
+	return gfalfs_deadline_run_once(GFALFS_OP_DATA, data, err_buff, s_err);
+}
+
+int gfalfs_timed_readdir(DIR* d, struct dirent* entry, char* err_buff, size_t s_err){
+	gboolean completed;
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_READDIR, NULL);
+	data->dir_arg = d;
+	const int res = gfalfs_deadline_run(GFALFS_OP_METADATA, data, &completed);
+	if(completed){
+		if(res > 0)
+			memcpy(entry, &(data->entry), sizeof(struct dirent));
+		if(res < 0)
+			g_strlcpy(err_buff, data->err_buff, s_err);
+		gfalfs_call_data_delete(data);
+	}else{
+		g_strlcpy(err_buff, strerror(-res), s_err);
+	}
+	return res;
+}
+
+int gfalfs_timed_closedir(DIR* d, char* err_buff, size_t s_err){
+	if(gfalfs_deadline_users_close(dir_table, d)){
+		gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_deadline closedir deferred after the abandoned calls");
+		return 0;
+	}
+	gfalfs_call_data* data = gfalfs_call_data_new(GFALFS_CALL_CLOSEDIR, NULL);
+	data->dir_arg = d;
+	return gfalfs_deadline_run_once(GFALFS_OP_METADATA, data, err_buff, s_err);
+}
+
+void gfalfs_deadline_get_stats(guint64* timeouts, guint64* interrupts){
+	*timeouts = g_atomic_int_get(&stat_timeouts);
+	*interrupts = g_atomic_int_get(&stat_interrupts);
+}
@@ -0,0 +1,71 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_deadline.h
+ * @brief deadlines of the remote operations, a call with a deadline runs in a
+ * worker thread and is abandoned when the deadline expires or when fuse
+ * signals an interruption, the fuse thread returns at once
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <glib.h>
+
+typedef enum{
+	GFALFS_OP_METADATA=0, // stat, open, opendir, readdir, closedir, readlink, access, getxattr, listxattr
+	GFALFS_OP_NAMESPACE, // mkdir, unlink, rmdir, rename, creat, symlink, chmod, setxattr
+	GFALFS_OP_DATA, // read, write, close
+	GFALFS_OP_CLASSES
+} gfalfs_op_class;
+
+// mark the current thread as a background thread of gfalFS, never interrupted by fuse
+void gfalfs_deadline_background_thread();
+
+// TRUE if fuse interrupted the request of the current thread, never for a background thread
+gboolean gfalfs_deadline_interrupted();
+
+// gfal2 calls with the deadline of their class, return the result or -errno
+// err_buff receives the error message, the gfal error of the thread is left clear
+int gfalfs_timed_lstat(const char* url, struct stat* st, char* err_buff, size_t s_err);
+int gfalfs_timed_open(const char* url, int flags, mode_t mode, char* err_buff, size_t s_err);
+DIR* gfalfs_timed_opendir(const char* url, int* errcode, char* err_buff, size_t s_err);
+ssize_t gfalfs_timed_pread(int fd, char* buf, size_t size, off_t offset, char* err_buff, size_t s_err);
+ssize_t gfalfs_timed_pwrite(int fd, const char* buf, size_t size, off_t offset, char* err_buff, size_t s_err);
+int gfalfs_timed_unlink(const char* url, char* err_buff, size_t s_err);
+int gfalfs_timed_mkdir(const char* url, mode_t mode, char* err_buff, size_t s_err);
+int gfalfs_timed_rmdir(const char* url, char* err_buff, size_t s_err);
+int gfalfs_timed_rename(const char* old_url, const char* new_url, char* err_buff, size_t s_err);
+int gfalfs_timed_creat(const char* url, mode_t mode, char* err_buff, size_t s_err);
+int gfalfs_timed_symlink(const char* target, const char* url, char* err_buff, size_t s_err);
+int gfalfs_timed_chmod(const char* url, mode_t mode, char* err_buff, size_t s_err);
+int gfalfs_timed_access(const char* url, int amode, char* err_buff, size_t s_err);
+// readlink, getxattr and listxattr return the size of the value, the buffer receives at most s_buff bytes of it
+ssize_t gfalfs_timed_readlink(const char* url, char* buff, size_t s_buff, char* err_buff, size_t s_err);
+ssize_t gfalfs_timed_getxattr(const char* url, const char* name, char* buff, size_t s_buff, char* err_buff, size_t s_err);
+int gfalfs_timed_setxattr(const char* url, const char* name, const char* value, size_t size, int flags, char* err_buff, size_t s_err);
+ssize_t gfalfs_timed_listxattr(const char* url, char* list, size_t s_list, char* err_buff, size_t s_err);
+
+// close a descriptor of gfalfs_timed_pread/pwrite, deferred while an abandoned call still uses it
+int gfalfs_timed_close(int fd, char* err_buff, size_t s_err);
+// copy the next entry of a directory in entry, return 1, 0 at the end of the directory or -errno
+int gfalfs_timed_readdir(DIR* d, struct dirent* entry, char* err_buff, size_t s_err);
+// close a directory of gfalfs_timed_opendir, deferred while an abandoned readdir still uses it
+int gfalfs_timed_closedir(DIR* d, char* err_buff, size_t s_err);
+
+// calls abandoned after their deadline and after an interruption
+void gfalfs_deadline_get_stats(guint64* timeouts, guint64* interrupts);
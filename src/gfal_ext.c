@@ -20,33 +20,95 @@
  * */
  
 #include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 #include <string.h>
 
 #include <gfal_api.h>
 
 #include "gfal_ext.h"
+#include "gfal_offline.h"
+#include "gfal_deadline.h"
+#include "gfal_blockcache.h"
+#include "gfal_bufpool.h"
 
 
 gfalFS_dir_handle gfalFS_dir_handle_new(void* fh, const char* dirpath){
+	// the saved dirent and the path in one pool buffer
+	char* buffer = gfalfs_buffer_alloc(sizeof(struct dirent) + strlen(dirpath) + 1);
+	if(buffer == NULL)
+		return NULL;
 	gfalFS_dir_handle ret = g_new0(struct _gfalFS_dir_handle, 1) ;
-	g_strlcpy(ret->path, dirpath, GFALFS_URL_MAX_LEN);
+	ret->saved = (struct dirent*) buffer;
+	ret->path = buffer + sizeof(struct dirent);
+	strcpy(ret->path, dirpath);
 	ret->fh = fh;
 	ret->offset = 0;
 	ret->mut = g_mutex_new();
+	// record the listing for the metadata cache, or to be served offline
+	if(fh != NULL && (gfalfs_get_md_cache_ttl() > 0 || gfalfs_get_offline_mode()))
+		ret->entries = g_array_new(FALSE, FALSE, sizeof(gfalfs_listing_entry));
 	return ret;
 }
 
+gfalFS_dir_handle gfalFS_dir_handle_new_from_listing(gfalfs_listing listing, const char* dirpath){
+	gfalFS_dir_handle ret = gfalFS_dir_handle_new(NULL, dirpath);
+	if(ret == NULL){
+		gfalfs_listing_unref(listing);
+		return NULL;
+	}
+	ret->listing = listing;
+	return ret;
+}
+
+
+static void gfalFS_dir_handle_free_entries(gfalFS_dir_handle handle){
+	if(handle->entries){
+		guint i;
+		for(i = 0; i < handle->entries->len; ++i)
+			g_free(g_array_index(handle->entries, gfalfs_listing_entry, i).name);
+		g_array_free(handle->entries, TRUE);
+		handle->entries = NULL;
+	}
+}
 
 void gfalFS_dir_handle_delete(gfalFS_dir_handle handle){
 	if(handle){
+		gfalFS_dir_handle_free_entries(handle);
+		gfalfs_listing_unref(handle->listing);
+		gfalfs_buffer_free((char*) handle->saved);
 		g_mutex_free (handle->mut);
 		free(handle);
 	}
 }
 
-int gfalFS_dir_handle_readdir(gfalFS_dir_handle handle, off_t offset, void* buf, fuse_fill_dir_t filler){
-	char buff[2048];
+static void gfalFS_dir_handle_fill_stat(const char* path, const char* name, ino_t ino, unsigned char d_type, struct stat* st){
+	memset(st, 0, sizeof(struct stat));
+	st->st_ino = (gfalfs_get_page_cache_mode())?gfalfs_child_ino(path, name):ino;
+	st->st_mode = d_type << 12;
+}
+
+// serve a readdir from a cached listing
+static int gfalFS_dir_handle_readdir_listing(gfalFS_dir_handle handle, const char* path, void* buf, fuse_fill_dir_t filler){
+	struct stat st;
+	while(handle->offset < handle->listing->n_entries){
+		gfalfs_listing_entry* entry = &(handle->listing->entries[handle->offset]);
+		gfalFS_dir_handle_fill_stat(path, entry->name, 0, entry->d_type, &st);
+		if(filler(buf, entry->name, &st, handle->offset+1) == 1) // buffer full
+			return 0;
+		handle->offset += 1;
+	}
+	return 0;
+}
+
+static void gfalFS_dir_handle_record(gfalFS_dir_handle handle, struct dirent* dir){
+	if(handle->entries){
+		gfalfs_listing_entry entry = { g_strdup(dir->d_name), dir->d_type };
+		g_array_append_val(handle->entries, entry);
+	}
+}
+
+int gfalFS_dir_handle_readdir(gfalFS_dir_handle handle, const char* path, off_t offset, void* buf, fuse_fill_dir_t filler){
 	char err_buff[1024];
 	int ret;
 	
@@ -54,13 +116,14 @@ int gfalFS_dir_handle_readdir(gfalFS_dir_handle handle, off_t offset, void* buf,
 		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_readdir err : Dir descriptor corruption, not in order %ld %ld", (long) offset, (long) handle->offset);
 		return -(EFAULT);
 	}
+	if(handle->listing != NULL)
+		return gfalFS_dir_handle_readdir_listing(handle, path, buf, filler);
+
 	if(handle->dir != NULL){ // try to recover from  previous saved status
 	
 		struct stat st;
-		memset(&st, 0, sizeof(st));
-		st.st_ino = handle->dir->d_ino;
-		st.st_mode = handle->dir->d_type << 12;	
-        gfalfs_tune_stat(&st);
+		gfalFS_dir_handle_fill_stat(path, handle->dir->d_name, handle->dir->d_ino, handle->dir->d_type, &st);
+        gfalfs_tune_stat(handle->path, &st);
 	
 		if( filler(buf, handle->dir->d_name, &st, handle->offset+1) ==1){ 
 			return 0; // filler buffer full 
@@ -71,14 +134,15 @@ int gfalFS_dir_handle_readdir(gfalFS_dir_handle handle, off_t offset, void* buf,
 		}
 	}
 	
-	while( (handle->dir = gfal_readdir(handle->fh)) != NULL){
-		if(fuse_interrupted())
+	// the entries are read in the pool buffer of the handle, kept there for the next call when the filler is full
+	while( (ret = gfalfs_timed_readdir(handle->fh, handle->saved, err_buff, 1024)) > 0){
+		handle->dir = handle->saved;
+		gfalFS_dir_handle_record(handle, handle->dir);
+		if(fuse_interrupted()) // the entry is filled by the next call
 			return -(ECANCELED);	
 			
 		struct stat st;
-		memset(&st, 0, sizeof(st));
-		st.st_ino = handle->dir->d_ino;
-		st.st_mode = handle->dir->d_type << 12;	
+		gfalFS_dir_handle_fill_stat(path, handle->dir->d_name, handle->dir->d_ino, handle->dir->d_type, &st);
 	
 		ret = filler(buf, handle->dir->d_name, &st, handle->offset+1);	
 		if(ret == 1) // buffer full
@@ -86,11 +150,16 @@ int gfalFS_dir_handle_readdir(gfalFS_dir_handle handle, off_t offset, void* buf,
 		handle->offset += 1;
 		
 	}
-    if( (ret = -(gfal_posix_code_error()))){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_readdir err %d for path %s: %s ", (int) gfal_posix_code_error(), (char*)buff, (char*)gfal_posix_strerror_r(err_buff, 1024));
-		gfal_posix_clear_error();
+	handle->dir = NULL;
+    if(ret < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_readdir err %d for path %s: %s ", -ret, (char*)handle->path, (char*) err_buff);
+		gfalFS_dir_handle_free_entries(handle);
 		return ret;
 	}
+	if(handle->entries){ // complete listing
+		gfalfs_cache_set_listing(path, gfalfs_listing_new(handle->entries), handle->generation);
+		handle->entries = NULL;
+	}
 	return 0;		
 		
 }
@@ -100,9 +169,430 @@ void* gfalFS_dir_handle_get_fd(gfalFS_dir_handle handle){
 }
 
 
-void gfalfs_tune_stat(struct stat * st){
-    // tune block size to 16Mega for cp optimization with big files on network file system
-    st->st_blksize = (1 <<24);
+// content read beyond the checksummed one, kept until the gap before it is read
+typedef struct _gfalfs_verify_chunk{
+	off_t offset;
+	size_t len;
+	char data[];
+} gfalfs_verify_chunk;
+
+// out of order content kept per handle for the verification, the kernel read-ahead needs much less
+#define GFALFS_VERIFY_PENDING_MAX (1 << 23)
+
+// stop the verification of a handle
+static void gfalFS_file_handle_verify_drop(gfalFS_file_handle handle){
+	g_list_foreach(handle->checksum_pending, (GFunc) g_free, NULL);
+	g_list_free(handle->checksum_pending);
+	handle->checksum_pending = NULL;
+	handle->checksum_pending_size = 0;
+	gfalfs_checksum_delete(handle->checksum);
+	handle->checksum = NULL;
+}
+
+gfalFS_file_handle gfalFS_file_handle_new(int fd, const char* path, const char* local_path, int flags){
+	gfalFS_file_handle ret = g_new0(struct _gfalFS_file_handle, 1);
+	g_strlcpy(ret->path, path, GFALFS_URL_MAX_LEN);
+	ret->local_path = g_strdup(local_path);
+	ret->fd = fd;
+	ret->flags = flags;
+	ret->offset = 0;
+	ret->mut = g_mutex_new();
+	ret->spool_fd = -1;
+	ret->size = -1;
+	ret->file_id = gfalfs_path_ino(local_path);
+	ret->pattern.prefetch_offset = -1;
+	ret->cond = g_cond_new();
+	return ret;
+}
+
+void gfalFS_file_handle_delete(gfalFS_file_handle handle){
+	if(handle){
+		gfalFS_file_handle_verify_drop(handle);
+		g_cond_free(handle->cond);
+		g_mutex_free(handle->mut);
+		g_free(handle->local_path);
+		g_free(handle);
+	}
+}
+
+int gfalFS_file_handle_get_fd(gfalFS_file_handle handle){
+	g_mutex_lock(handle->mut);
+	const int fd = handle->fd;
+	g_mutex_unlock(handle->mut);
+	return fd;
+}
+
+
+// number of transfers recovered by a reopen, and given up after retries
+static volatile gint recovery_count = 0;
+static volatile gint recovery_failures = 0;
+
+// longest wait between two attempts, in milli-seconds
+#define GFALFS_RETRY_MAX_DELAY 30000
+
+// errors of a broken connection or session, a new descriptor may succeed
+gboolean gfalfs_errno_is_transient(int err){
+	switch(err){
+		case EAGAIN:
+		case ETIMEDOUT:
+		case ECONNRESET:
+		case ECONNABORTED:
+		case ECONNREFUSED:
+		case ENOTCONN:
+		case ENETDOWN:
+		case ENETRESET:
+		case ENETUNREACH:
+		case EHOSTUNREACH:
+		case EHOSTDOWN:
+		case EPIPE:
+#ifdef ECOMM
+		case ECOMM:
+#endif
+#ifdef EKEYEXPIRED
+		case EKEYEXPIRED:
+#endif
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+// replace the descriptor failed_fd by a new one, unless another thread did it already
+// a handle opened while offline gets its first descriptor with failed_fd = -1
+// the open runs without the handle lock, the descriptor is swapped under it
+// the close of the old descriptor is deferred while a concurrent call still uses it
+static int gfalFS_file_handle_reopen(gfalFS_file_handle handle, int failed_fd){
+	char err_buff[1024];
+	if(gfalFS_file_handle_get_fd(handle) != failed_fd)
+		return 0;
+	const int fd = gfalfs_timed_open(handle->path, handle->flags & ~(O_CREAT | O_EXCL | O_TRUNC), 0, err_buff, 1024);
+	if(fd < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_reopen err %d for path %s: %s ", -fd, (char*) handle->path, (char*) err_buff);
+		return fd;
+	}
+	g_mutex_lock(handle->mut);
+	const gboolean replaced = (handle->fd == failed_fd);
+	if(replaced)
+		handle->fd = fd;
+	g_mutex_unlock(handle->mut);
+	if(!replaced) // a concurrent reopen was first
+		gfalfs_timed_close(fd, err_buff, 1024);
+	else if(failed_fd >= 0)
+		gfalfs_timed_close(failed_fd, err_buff, 1024);
+	return 0;
+}
+
+// TRUE if a write at offset continues the remote content after a reopen
+// the remote file must end at offset, a truncating reopen only allows a write at 0
+static gboolean gfalFS_file_handle_write_resumes(gfalFS_file_handle handle, off_t offset){
+	char err_buff[1024];
+	struct stat st;
+	if(offset == 0)
+		return TRUE;
+	if(gfalfs_timed_lstat(handle->path, &st, err_buff, 1024) != 0)
+		return FALSE;
+	return (st.st_size == offset);
+}
+
+// pread or pwrite at offset, reopen the file and retry with an exponential backoff on transient errors
+// a failed write is retried only if the reopened file ends at offset, a new descriptor of a sequential
+// protocol would lose the content written before
+static ssize_t gfalFS_file_handle_io(gfalFS_file_handle handle, gboolean write, char* buf, size_t size, off_t offset){
+	char err_buff[1024];
+	gulong delay = gfalfs_get_retry_delay();
+	guint64 attempt;
+	int fd = gfalFS_file_handle_get_fd(handle);
+	int err = 0;
+
+	if(gfalfs_offline_active(handle->local_path)) // only the cached content is available
+		return -(GFALFS_OFFLINE_ERRNO);
+	if(fd < 0) // opened while offline
+		err = -(gfalFS_file_handle_reopen(handle, fd));
+	for(attempt = 0; ; ++attempt){
+		if(attempt > 0){
+			g_usleep(delay * 1000);
+			delay = MIN(delay * 2, GFALFS_RETRY_MAX_DELAY);
+			err = -(gfalFS_file_handle_reopen(handle, fd));
+			if(err == 0 && write && gfalFS_file_handle_write_resumes(handle, offset) == FALSE){
+				gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_pwrite %s not resumed, the remote content does not end at offset %ld",
+								(char*) handle->path, (long) offset);
+				err = EIO;
+				attempt = gfalfs_get_retries();
+			}
+		}
+		fd = gfalFS_file_handle_get_fd(handle);
+		if(err == 0){
+			const gint64 start = g_get_monotonic_time();
+			const ssize_t ret = (write)?gfalfs_timed_pwrite(fd, buf, size, offset, err_buff, 1024)
+										:gfalfs_timed_pread(fd, buf, size, offset, err_buff, 1024);
+			const gint64 usec = g_get_monotonic_time() - start;
+			gfalfs_offline_report(handle->local_path, (ret < 0)?-ret:0, usec);
+			if(ret >= 0){
+				gfalfs_report_transfer(handle->path, ret, usec);
+				g_mutex_lock(handle->mut);
+				if(write)
+					handle->bytes_written += ret;
+				else
+					handle->bytes_read += ret;
+				handle->transfer_usec += usec;
+				g_mutex_unlock(handle->mut);
+				if(attempt > 0){
+					g_atomic_int_inc(&recovery_count);
+					gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_%s %s recovered at offset %ld after %lu retries",
+								(write)?"pwrite":"pread", (char*) handle->path, (long) offset, (unsigned long) attempt);
+				}
+				return ret;
+			}
+			err = -ret;
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_%s err %d for path %s: %s ", (write)?"pwrite":"pread", err, (char*) handle->path, (char*) err_buff);
+		}
+		if(attempt >= gfalfs_get_retries() || gfalfs_errno_is_transient(err) == FALSE || err == ECANCELED
+			|| gfalfs_offline_active(handle->local_path)){
+			if(attempt > 0)
+				g_atomic_int_inc(&recovery_failures);
+			return -err;
+		}
+		err = 0;
+	}
+}
+
+ssize_t gfalFS_file_handle_pread(gfalFS_file_handle handle, char* buf, size_t size, off_t offset){
+	return gfalFS_file_handle_io(handle, FALSE, buf, size, offset);
+}
+
+ssize_t gfalFS_file_handle_pwrite(gfalFS_file_handle handle, const char* buf, size_t size, off_t offset){
+	return gfalFS_file_handle_io(handle, TRUE, (char*) buf, size, offset);
+}
+
+void gfalfs_recovery_get_stats(guint64* recoveries, guint64* failures){
+	*recoveries = g_atomic_int_get(&recovery_count);
+	*failures = g_atomic_int_get(&recovery_failures);
+}
+
+gboolean gfalFS_file_handle_is_staged(gfalFS_file_handle handle){
+	return handle->spool_fd >= 0;
+}
+
+void gfalFS_file_handle_verify_start(gfalFS_file_handle handle){
+	struct stat st;
+	if(gfalfs_get_checksum_type() == GFALFS_CHECKSUM_NONE)
+		return;
+	handle->checksum = gfalfs_checksum_new(gfalfs_get_checksum_type());
+	handle->checksum_offset = 0;
+	handle->checksum_end = -1;
+	handle->size = (gfalfs_cache_peek_stat(handle->local_path, &st))?st.st_size:-1;
+}
+
+// compare the digest of the content read with the remote checksum, without the handle lock
+static void gfalFS_file_handle_verify_end(gfalFS_file_handle handle, gfalfs_checksum_type type, const char* local_sum){
+	char remote_sum[GFALFS_CHECKSUM_MAX_LEN];
+	if(gfalfs_checksum_remote(handle->path, type, remote_sum, GFALFS_CHECKSUM_MAX_LEN) == 0){
+		if(gfalfs_checksum_equal(local_sum, remote_sum)){
+			gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_verify %s content trusted, %s %s", (char*) handle->path, gfalfs_checksum_type_name(type), local_sum);
+			gfalfs_cache_set_trusted(handle->local_path, local_sum);
+			if(gfalfs_get_readahead_mode())
+				gfalfs_blockcache_set_trusted(handle->file_id, local_sum);
+		}else{
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_verify %s checksum mismatch, %s local %s remote %s", (char*) handle->path, gfalfs_checksum_type_name(type), local_sum, remote_sum);
+			if(gfalfs_get_readahead_mode())
+				gfalfs_blockcache_set_trusted(handle->file_id, NULL);
+			gfalfs_cache_invalidate(handle->local_path);
+		}
+	}
+}
+
+// checksum the part of a content beyond checksum_offset, called with the handle lock
+static void gfalFS_file_handle_verify_update(gfalFS_file_handle handle, const char* buf, off_t offset, size_t len){
+	if(offset + (off_t) len > handle->checksum_offset){
+		const off_t skip = handle->checksum_offset - offset;
+		gfalfs_checksum_update(handle->checksum, buf + skip, len - skip);
+		handle->checksum_offset = offset + len;
+	}
+}
+
+static gint gfalfs_verify_chunk_cmp(gconstpointer a, gconstpointer b){
+	const off_t oa = ((const gfalfs_verify_chunk*) a)->offset;
+	const off_t ob = ((const gfalfs_verify_chunk*) b)->offset;
+	return (oa < ob)?-1:((oa > ob)?1:0);
+}
+
+void gfalFS_file_handle_verify(gfalFS_file_handle handle, const char* buf, off_t offset, size_t len, size_t requested){
+	char local_sum[GFALFS_CHECKSUM_MAX_LEN];
+	gfalfs_checksum_type type = GFALFS_CHECKSUM_NONE;
+	g_mutex_lock(handle->mut);
+	if(handle->checksum != NULL){
+		if(len < requested && (handle->checksum_end < 0 || offset + (off_t) len < handle->checksum_end))
+			handle->checksum_end = offset + len;
+		if(offset > handle->checksum_offset){ // read ahead of a gap, kept until the gap is read
+			if(len > 0 && handle->checksum_pending_size + len <= GFALFS_VERIFY_PENDING_MAX){
+				gfalfs_verify_chunk* chunk = g_malloc(sizeof(gfalfs_verify_chunk) + len);
+				chunk->offset = offset;
+				chunk->len = len;
+				memcpy(chunk->data, buf, len);
+				handle->checksum_pending = g_list_insert_sorted(handle->checksum_pending, chunk, gfalfs_verify_chunk_cmp);
+				handle->checksum_pending_size += len;
+			}else if(len > 0){
+				gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_verify %s not verified, more than %lu bytes read out of order",
+							(char*) handle->path, (unsigned long) GFALFS_VERIFY_PENDING_MAX);
+				gfalFS_file_handle_verify_drop(handle);
+			}
+		}else{
+			gfalFS_file_handle_verify_update(handle, buf, offset, len);
+			while(handle->checksum_pending != NULL
+					&& ((gfalfs_verify_chunk*) handle->checksum_pending->data)->offset <= handle->checksum_offset){
+				gfalfs_verify_chunk* chunk = (gfalfs_verify_chunk*) handle->checksum_pending->data;
+				gfalFS_file_handle_verify_update(handle, chunk->data, chunk->offset, chunk->len);
+				handle->checksum_pending_size -= chunk->len;
+				handle->checksum_pending = g_list_delete_link(handle->checksum_pending, handle->checksum_pending);
+				g_free(chunk);
+			}
+		}
+		const off_t end = (handle->checksum_end >= 0)?handle->checksum_end:handle->size;
+		if(handle->checksum != NULL && end >= 0 && handle->checksum_offset >= end){
+			type = handle->checksum->type;
+			gfalfs_checksum_get_string(handle->checksum, local_sum, GFALFS_CHECKSUM_MAX_LEN);
+			gfalFS_file_handle_verify_drop(handle);
+		}
+	}
+	g_mutex_unlock(handle->mut);
+	if(type != GFALFS_CHECKSUM_NONE)
+		gfalFS_file_handle_verify_end(handle, type, local_sum);
+}
+
+// observed throughput per endpoint, in bytes per second
+static GStaticMutex throughput_mutex = G_STATIC_MUTEX_INIT;
+static GHashTable* throughput_table = NULL;
+
+// a block is sized to be transfered in about 1/4 second at the observed throughput
+#define GFALFS_BLKSIZE_TRANSFER_FRACTION 4
+// transfers smaller than this are dominated by the latency, ignored for the throughput
+#define GFALFS_THROUGHPUT_MIN_SAMPLE (1 << 16)
+
+// extract "protocol://host[:port]" from an url
+static void gfalfs_url_endpoint(const char* url, char* buff, size_t s_buff){
+	const char* p = strstr(url, "://");
+	if(p == NULL){
+		g_strlcpy(buff, "", s_buff);
+		return;
+	}
+	p += 3;
+	while(*p != '\0' && *p != '/')
+		++p;
+	g_strlcpy(buff, url, MIN(s_buff, (size_t)(p - url) + 1));
+}
+
+void gfalfs_report_transfer(const char* url, size_t size, gint64 usec){
+	char endpoint[GFALFS_URL_MAX_LEN];
+	if(size < GFALFS_THROUGHPUT_MIN_SAMPLE || usec <= 0)
+		return;
+	gfalfs_url_endpoint(url, endpoint, GFALFS_URL_MAX_LEN);
+	const gdouble sample = ((gdouble) size) * G_USEC_PER_SEC / usec;
+
+	g_static_mutex_lock(&throughput_mutex);
+	if(throughput_table == NULL)
+		throughput_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	gdouble* throughput = g_hash_table_lookup(throughput_table, endpoint);
+	if(throughput == NULL){
+		throughput = g_new(gdouble, 1);
+		*throughput = sample;
+		g_hash_table_insert(throughput_table, g_strdup(endpoint), throughput);
+	}else{
+		*throughput = 0.8 * (*throughput) + 0.2 * sample;
+	}
+	g_static_mutex_unlock(&throughput_mutex);
+}
+
+static gdouble gfalfs_endpoint_throughput(const char* url){
+	char endpoint[GFALFS_URL_MAX_LEN];
+	gdouble res = 0;
+	gfalfs_url_endpoint(url, endpoint, GFALFS_URL_MAX_LEN);
+	g_static_mutex_lock(&throughput_mutex);
+	if(throughput_table != NULL){
+		gdouble* throughput = g_hash_table_lookup(throughput_table, endpoint);
+		if(throughput)
+			res = *throughput;
+	}
+	g_static_mutex_unlock(&throughput_mutex);
+	return res;
+}
+
+// default block size of a protocol before any throughput measurement
+static guint64 gfalfs_protocol_blksize(const char* url){
+	if(strncmp(url, "file:", 5) == 0)
+		return (1 << 17);
+	if(strncmp(url, "http", 4) == 0 || strncmp(url, "dav", 3) == 0)
+		return (1 << 20);
+	if(strncmp(url, "root", 4) == 0 || strncmp(url, "xroot", 5) == 0)
+		return (1 << 22);
+	// cp optimization with big files on grid protocols (gsiftp, srm, ...)
+	return (1 << 24);
+}
+
+static guint64 gfalfs_round_pow2(guint64 val){
+	guint64 res = 1;
+	while(res < val && res < (G_GUINT64_CONSTANT(1) << 62))
+		res <<= 1;
+	return res;
+}
+
+static guint64 gfalfs_compute_blksize(const char* url, off_t size){
+	if(gfalfs_get_blksize() != 0)
+		return gfalfs_get_blksize();
+
+	guint64 res;
+	const gdouble throughput = gfalfs_endpoint_throughput(url);
+	if(throughput > 0)
+		res = gfalfs_round_pow2((guint64) (throughput / GFALFS_BLKSIZE_TRANSFER_FRACTION));
+	else
+		res = gfalfs_protocol_blksize(url);
+	// no need of a buffer bigger than the file itself
+	if(size > 0)
+		res = MIN(res, gfalfs_round_pow2(size));
+	return CLAMP(res, gfalfs_get_blksize_min(), gfalfs_get_blksize_max());
+}
+
+void gfalfs_tune_stat(const char* url, struct stat * st){
+    // tune block size for the protocol, the file size and the observed throughput
+    st->st_blksize = gfalfs_compute_blksize(url, st->st_size);
     // workaround for utilities like du that use st_blocks (LCGUTIL-289)
     st->st_blocks = ceil(st->st_size / 512.0);
 }
+
+void gfalfs_record_stat(const char* path, const char* url, struct stat * st){
+	gfalfs_tune_stat(url, st);
+	if(gfalfs_get_page_cache_mode())
+		st->st_ino = gfalfs_path_ino(path);
+	if(gfalfs_cache_enabled())
+		gfalfs_cache_set_stat(path, st);
+}
+
+
+// 64 bits FNV-1a hash
+#define GFALFS_FNV_OFFSET G_GUINT64_CONSTANT(14695981039346656037)
+#define GFALFS_FNV_PRIME G_GUINT64_CONSTANT(1099511628211)
+
+static guint64 gfalfs_hash_update(guint64 hash, const char* str){
+	for(; *str != '\0'; ++str){
+		hash ^= (guchar) *str;
+		hash *= GFALFS_FNV_PRIME;
+	}
+	return hash;
+}
+
+// inode 0 is invalid and 1 is reserved for the fuse root
+static ino_t gfalfs_hash_to_ino(guint64 hash){
+	return (hash > 1)?((ino_t)hash):(hash+2);
+}
+
+ino_t gfalfs_path_ino(const char* path){
+	if(strcmp(path, "/") == 0)
+		return 1;
+	return gfalfs_hash_to_ino(gfalfs_hash_update(GFALFS_FNV_OFFSET, path));
+}
+
+ino_t gfalfs_child_ino(const char* dir_path, const char* name){
+	guint64 hash = gfalfs_hash_update(GFALFS_FNV_OFFSET, dir_path);
+	if(strcmp(dir_path, "/") != 0)
+		hash = gfalfs_hash_update(hash, "/");
+	return gfalfs_hash_to_ino(gfalfs_hash_update(hash, name));
+}
@@ -24,44 +24,126 @@
 #include <stdlib.h>
 #include <glib.h>
 #include "gfal_opers.h"
+#include "gfal_cache.h"
+#include "gfal_checksum.h"
 #include "params.h"
 
+typedef enum{
+	GFALFS_PATTERN_RANDOM=0,
+	GFALFS_PATTERN_SEQUENTIAL,
+	GFALFS_PATTERN_STRIDED
+} gfalfs_pattern_type;
+
+// access pattern of the reads on a handle
+typedef struct _gfalfs_read_pattern{
+	gfalfs_pattern_type type;
+	off_t last_offset;
+	size_t last_size;
+	off_t stride; // last distance between two read offsets
+	guint sequential_run; // consecutive contiguous reads
+	guint strided_run; // consecutive reads with the same stride
+	off_t prefetch_offset; // start of the last prefetched range, -1 if none
+	// statistics
+	guint64 reads;
+	guint64 cache_hits;
+	guint64 remote_reads;
+} gfalfs_read_pattern;
+
 typedef struct _gfalFS_file_handle{
 	char path[GFALFS_URL_MAX_LEN];
-	void* fh;
+	char* local_path;
+	int fd; // gfal descriptor, -1 if none
+	int flags;
 	off_t offset;
 	GMutex* mut;
+	// local staging
+	int spool_fd; // local spool file, -1 if the file is not staged
+	off_t spool_size; // bytes reserved in the spool
+	mode_t mode;
+	gboolean dirty; // spool content not uploaded yet, protected by mut
+	guint spool_users; // control operations using the spool, protected by the staged table lock
+	// verification of the content read sequentially
+	gfalfs_checksum checksum; // NULL if no verification
+	off_t checksum_offset; // end of the checksummed content
+	off_t checksum_end; // end of the file seen by a short read, -1 if unknown
+	GList* checksum_pending; // content read beyond checksum_offset, sorted by offset
+	gsize checksum_pending_size;
+	off_t size; // expected size, -1 if unknown
+	// read-ahead
+	guint64 file_id;
+	gfalfs_read_pattern pattern;
+	gint prefetching; // pending prefetch tasks
+	gboolean closing;
+	volatile gint cached_dropped; // the cached blocks of the file were dropped by a write
+	GCond* cond;
+	// remote transfers through the handle
+	guint64 bytes_read;
+	guint64 bytes_written;
+	gint64 transfer_usec;
 	
 } *gfalFS_file_handle;
 
 
 typedef struct _gfalFS_dir_handle{
-	char path[GFALFS_URL_MAX_LEN];
+	char* path;
 	void* fh;
 	off_t offset; // current offset
 	struct dirent* dir; // last dir, NULL if no state 
+	struct dirent* saved; // copy of the last dir not filled, shares the pool buffer of path
 	GMutex* mut;
+	gfalfs_listing listing; // cached listing served instead of fh, NULL if none
+	GArray* entries; // entries read so far, stored in the cache at the end of the listing
+	guint64 generation; // cache generation before the remote opendir
 	
 } *gfalFS_dir_handle;
 
 
+// NULL if no buffer is available, the listing is released
 gfalFS_dir_handle gfalFS_dir_handle_new(void* fh, const char* dirpath);
-int gfalFS_dir_handle_readdir(gfalFS_dir_handle handle, off_t offset, void* buff, fuse_fill_dir_t filler);
+gfalFS_dir_handle gfalFS_dir_handle_new_from_listing(gfalfs_listing listing, const char* dirpath);
+int gfalFS_dir_handle_readdir(gfalFS_dir_handle handle, const char* path, off_t offset, void* buff, fuse_fill_dir_t filler);
 void* gfalFS_dir_handle_get_fd(gfalFS_dir_handle handle);
 void gfalFS_dir_handle_delete(gfalFS_dir_handle handle);
 
 
-gfalFS_file_handle gfalFS_file_handle_new(void* fh, const char* path);
+gfalFS_file_handle gfalFS_file_handle_new(int fd, const char* path, const char* local_path, int flags);
 
 
 void gfalFS_file_handle_delete(gfalFS_file_handle handle);
 
-void* gfalFS_file_handle_get_fd(gfalFS_file_handle handle);
+int gfalFS_file_handle_get_fd(gfalFS_file_handle handle);
+
+// pread and pwrite on the handle, reopen the remote file and retry on transient errors, a write only where the remote file ends
+// return the transfered size or -errno, the gfal error is cleared
+ssize_t gfalFS_file_handle_pread(gfalFS_file_handle handle, char* buf, size_t size, off_t offset);
+ssize_t gfalFS_file_handle_pwrite(gfalFS_file_handle handle, const char* buf, size_t size, off_t offset);
+
+// TRUE for the errors of a broken connection or session, a new attempt may succeed
+gboolean gfalfs_errno_is_transient(int err);
+
+// number of transfers recovered after a reopen, and of transfers failed after all the retries
+void gfalfs_recovery_get_stats(guint64* recoveries, guint64* failures);
+
+gboolean gfalFS_file_handle_is_staged(gfalFS_file_handle handle);
+
+// start the checksum verification of the content read through the handle
+void gfalFS_file_handle_verify_start(gfalFS_file_handle handle);
+
+// account the content read through the handle, verify it with the storage checksum at the end of the file
+void gfalFS_file_handle_verify(gfalFS_file_handle handle, const char* buf, off_t offset, size_t len, size_t requested);
+
+
+void gfalfs_tune_stat(const char* url, struct stat * st);
 
-int gfalFS_file_handle_write(gfalFS_file_handle handle, const char *buf, size_t size, off_t offset);
+// tune the attributes of a path fetched from url and record them in the metadata cache
+void gfalfs_record_stat(const char* path, const char* url, struct stat * st);
 
-int gfalFS_file_handle_read(gfalFS_file_handle handle, const char *buf, size_t size, off_t offset);
+// report a transfer of size bytes in usec micro-seconds, used to tune the block size
+void gfalfs_report_transfer(const char* url, size_t size, gint64 usec);
 
+// stable inode number of a local path, used in page cache mode
+ino_t gfalfs_path_ino(const char* path);
 
-void gfalfs_tune_stat(struct stat * st);
+// stable inode number of the entry "name" of the directory "dir_path"
+ino_t gfalfs_child_ino(const char* dir_path, const char* name);
 
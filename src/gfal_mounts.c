@@ -0,0 +1,201 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+
+/*
+ * gfal_mounts.c
+ * mount table of the multi-mount mode, the remote prefixes share the process,
+ * its threads, its buffer pool and its caches
+ * */
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gfal_mounts.h"
+#include "params.h"
+
+#define GFALFS_MOUNTS_GROUP "mounts"
+
+typedef struct _gfalfs_mount{
+	char* name;
+	char* url; // without trailing '/'
+	size_t s_url;
+	int index;
+} gfalfs_mount;
+
+// immutable once loaded
+static GPtrArray* mounts = NULL;
+static GHashTable* mounts_by_name = NULL;
+static time_t mounts_time = 0;
+
+
+static gboolean gfalfs_mounts_add(const char* name, const char* url){
+	if(*name == '\0' || strchr(name, '/') != NULL || strcmp(name, ".") == 0 || strcmp(name, "..") == 0){
+		g_printerr("Invalid mount name : %s \n", name);
+		return FALSE;
+	}
+	if(strstr(url, "://") == NULL){
+		g_printerr("Invalid url for the mount %s : %s \n", name, url);
+		return FALSE;
+	}
+	if(g_hash_table_lookup(mounts_by_name, name) != NULL){
+		g_printerr("Mount %s declared twice \n", name);
+		return FALSE;
+	}
+	gfalfs_mount* mount = g_new0(gfalfs_mount, 1);
+	mount->name = g_strdup(name);
+	mount->url = g_strdup(url);
+	mount->s_url = strlen(mount->url);
+	while(mount->s_url > 0 && mount->url[mount->s_url-1] == '/')
+		mount->url[--mount->s_url] = '\0';
+	mount->index = mounts->len;
+	g_ptr_array_add(mounts, mount);
+	g_hash_table_insert(mounts_by_name, mount->name, mount);
+	return TRUE;
+}
+
+gboolean gfalfs_mounts_load(const char* config_file){
+	GError* tmp_err = NULL;
+	gboolean res = TRUE;
+	gsize n_keys = 0, i;
+	GKeyFile* key_file = g_key_file_new();
+	gchar** keys = NULL;
+
+	if(g_key_file_load_from_file(key_file, config_file, G_KEY_FILE_NONE, &tmp_err) == FALSE
+		|| (keys = g_key_file_get_keys(key_file, GFALFS_MOUNTS_GROUP, &n_keys, &tmp_err)) == NULL){
+		g_printerr("Unable to load the mount table %s : %s \n", config_file, tmp_err->message);
+		g_error_free(tmp_err);
+		g_key_file_free(key_file);
+		return FALSE;
+	}
+	mounts = g_ptr_array_new();
+	mounts_by_name = g_hash_table_new(g_str_hash, g_str_equal);
+	for(i = 0; i < n_keys && res; ++i){
+		gchar* url = g_key_file_get_string(key_file, GFALFS_MOUNTS_GROUP, keys[i], NULL);
+		res = (url != NULL && gfalfs_mounts_add(keys[i], g_strstrip(url)));
+		g_free(url);
+	}
+	if(res && mounts->len == 0){
+		g_printerr("No mount declared in the group [%s] of %s \n", GFALFS_MOUNTS_GROUP, config_file);
+		res = FALSE;
+	}
+	g_strfreev(keys);
+	g_key_file_free(key_file);
+	mounts_time = time(NULL);
+	return res;
+}
+
+gboolean gfalfs_mounts_enabled(){
+	return mounts != NULL;
+}
+
+guint gfalfs_mounts_count(){
+	return (mounts)?mounts->len:0;
+}
+
+const char* gfalfs_mounts_name(guint i){
+	return ((gfalfs_mount*) g_ptr_array_index(mounts, i))->name;
+}
+
+gboolean gfalfs_mounts_is_root(const char* path){
+	return path[0] == '/' && path[1] == '\0';
+}
+
+// mount of the top level directory of path, rest points after the directory name
+static gfalfs_mount* gfalfs_mounts_lookup(const char* path, const char** rest){
+	char name[NAME_MAX+1];
+	const char* p = path + 1;
+	const char* end = strchr(p, '/');
+	const size_t s_name = (end)?(size_t)(end - p):strlen(p);
+	if(s_name == 0 || s_name > NAME_MAX)
+		return NULL;
+	memcpy(name, p, s_name);
+	name[s_name] = '\0';
+	*rest = p + s_name;
+	return g_hash_table_lookup(mounts_by_name, name);
+}
+
+int gfalfs_mounts_index(const char* path){
+	const char* rest = NULL;
+	gfalfs_mount* mount = gfalfs_mounts_lookup(path, &rest);
+	return (mount)?mount->index:-1;
+}
+
+int gfalfs_mounts_check_change(const char* path){
+	if(gfalfs_mounts_is_root(path))
+		return -(EBUSY);
+	if(strchr(path + 1, '/') == NULL) // top level entry, the mounts are fixed by the table
+		return (gfalfs_mounts_index(path) >= 0)?-(EBUSY):-(EACCES);
+	return 0;
+}
+
+int gfalfs_mounts_check_rename(const char* old_path, const char* new_path){
+	int ret;
+	if( (ret = gfalfs_mounts_check_change(old_path)) < 0
+		|| (ret = gfalfs_mounts_check_change(new_path)) < 0)
+		return ret;
+	if(gfalfs_mounts_index(old_path) != gfalfs_mounts_index(new_path))
+		return -(EXDEV);
+	return 0;
+}
+
+gboolean gfalfs_mounts_construct_path(const char* path, char* buff, size_t s_buff){
+	const char* rest = NULL;
+	gfalfs_mount* mount = gfalfs_mounts_lookup(path, &rest);
+	if(mount == NULL){
+		g_strlcpy(buff, "", s_buff);
+		return FALSE;
+	}
+	g_strlcpy(buff, mount->url, s_buff);
+	g_strlcat(buff, rest, s_buff);
+	return TRUE;
+}
+
+gboolean gfalfs_mounts_url_to_path(const char* url, char* buff, size_t s_buff){
+	guint i;
+	for(i = 0; i < mounts->len; ++i){
+		gfalfs_mount* mount = g_ptr_array_index(mounts, i);
+		if(strncmp(url, mount->url, mount->s_url) == 0
+			&& (url[mount->s_url] == '\0' || url[mount->s_url] == '/')){
+			g_snprintf(buff, s_buff, "/%s%s", mount->name, url + mount->s_url);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+void gfalfs_mounts_root_stat(struct stat* st){
+	memset(st, 0, sizeof(struct stat));
+	st->st_mode = S_IFDIR | 0555;
+	st->st_nlink = 2 + gfalfs_mounts_count();
+	st->st_uid = getuid();
+	st->st_gid = getgid();
+	st->st_ino = 1;
+	st->st_atime = st->st_mtime = st->st_ctime = mounts_time;
+}
+
+gfalfs_listing gfalfs_mounts_root_listing(){
+	GArray* entries = g_array_new(FALSE, FALSE, sizeof(gfalfs_listing_entry));
+	guint i;
+	for(i = 0; i < gfalfs_mounts_count(); ++i){
+		gfalfs_listing_entry entry = { g_strdup(gfalfs_mounts_name(i)), DT_DIR };
+		g_array_append_val(entries, entry);
+	}
+	return gfalfs_listing_new(entries);
+}
@@ -0,0 +1,65 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_mounts.h
+ * @brief multi-mount mode, several remote prefixes served as the top level
+ * directories of one mount point, declared in a key file :
+ *
+ * [mounts]
+ * name = remote url
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "gfal_cache.h"
+
+// load the mount table, return FALSE and print the error if the file is invalid
+gboolean gfalfs_mounts_load(const char* config_file);
+
+// TRUE if a mount table is loaded
+gboolean gfalfs_mounts_enabled();
+
+guint gfalfs_mounts_count();
+
+const char* gfalfs_mounts_name(guint i);
+
+// TRUE for the virtual root directory of the mount table
+gboolean gfalfs_mounts_is_root(const char* path);
+
+// index of the mount of a local path, -1 for the root or an unknown name
+int gfalfs_mounts_index(const char* path);
+
+// check a change of the namespace at a local path, 0 if allowed,
+// -EBUSY for the root and the mounts themselves, -EACCES for an other top level entry
+int gfalfs_mounts_check_change(const char* path);
+
+// check a rename, as gfalfs_mounts_check_change for both paths, -EXDEV between two mounts
+int gfalfs_mounts_check_rename(const char* old_path, const char* new_path);
+
+// convert a local path to an url, return FALSE if its top level directory is not declared
+gboolean gfalfs_mounts_construct_path(const char* path, char* buff, size_t s_buff);
+
+// convert an url to a local path, return FALSE if it is not under a declared url
+gboolean gfalfs_mounts_url_to_path(const char* url, char* buff, size_t s_buff);
+
+// attributes of the virtual root directory
+void gfalfs_mounts_root_stat(struct stat* st);
+
+// listing of the virtual root directory, to release with gfalfs_listing_unref
+gfalfs_listing gfalfs_mounts_root_listing();
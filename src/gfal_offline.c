@@ -0,0 +1,132 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+
+/*
+ * gfal_offline.c
+ * a storage is considered offline after offline_errors consecutive connection
+ * or timeout errors or operations slower than offline_timeout, a probe thread checks its
+ * root every offline_probe seconds and restores the online mode
+ * */
+
+#include <errno.h>
+#include <string.h>
+
+#include <gfal_api.h>
+
+#include "gfal_offline.h"
+#include "gfal_ext.h"
+#include "gfal_mounts.h"
+
+typedef struct _gfalfs_offline_state{
+	volatile gint offline;
+	volatile gint failures; // consecutive failures
+	char* root; // local path probed while offline
+} gfalfs_offline_state;
+
+// one state per mounted url, immutable array once initialized
+static gfalfs_offline_state* states = NULL;
+static guint n_states = 0;
+
+
+void gfalfs_offline_init(){
+	guint i;
+	if(gfalfs_get_offline_mode() == FALSE || states != NULL)
+		return;
+	n_states = (gfalfs_mounts_enabled())?gfalfs_mounts_count():1;
+	states = g_new0(gfalfs_offline_state, n_states);
+	for(i = 0; i < n_states; ++i)
+		states[i].root = (gfalfs_mounts_enabled())?g_strconcat("/", gfalfs_mounts_name(i), NULL):g_strdup("/");
+}
+
+// errors of an unreachable storage, the other errors are answers of the storage
+static gboolean gfalfs_offline_errno_counts(int err){
+	switch(err){
+		case ETIMEDOUT:
+		case ECONNRESET:
+		case ECONNABORTED:
+		case ECONNREFUSED:
+		case ENOTCONN:
+		case ENETDOWN:
+		case ENETRESET:
+		case ENETUNREACH:
+		case EHOSTUNREACH:
+		case EHOSTDOWN:
+#ifdef ECOMM
+		case ECOMM:
+#endif
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+static gfalfs_offline_state* gfalfs_offline_get_state(const char* path){
+	if(states == NULL)
+		return NULL;
+	if(gfalfs_mounts_enabled()){
+		const int i = gfalfs_mounts_index(path);
+		return (i >= 0)?&(states[i]):NULL;
+	}
+	return &(states[0]);
+}
+
+static gpointer gfalfs_offline_probe(gpointer data){
+	gfalfs_offline_state* state = (gfalfs_offline_state*) data;
+	char url[GFALFS_URL_MAX_LEN];
+	struct stat st;
+	gfalfs_construct_path(state->root, url, GFALFS_URL_MAX_LEN);
+	while(1){
+		g_usleep(gfalfs_get_offline_probe() * G_USEC_PER_SEC);
+		const gint64 start = g_get_monotonic_time();
+		const int ret = gfal_lstat(url, &st);
+		const int errcode = (ret < 0)?gfal_posix_code_error():0;
+		gfal_posix_clear_error();
+		if(gfalfs_offline_errno_counts(errcode) == FALSE
+			&& g_get_monotonic_time() - start < (gint64) gfalfs_get_offline_timeout() * G_USEC_PER_SEC)
+			break;
+		gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_offline probe of %s failed, err %d", url, errcode);
+	}
+	g_atomic_int_set(&(state->failures), 0);
+	g_atomic_int_set(&(state->offline), 0);
+	gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_offline %s is back online", url);
+	return NULL;
+}
+
+void gfalfs_offline_report(const char* path, int errcode, gint64 usec){
+	gfalfs_offline_state* state = gfalfs_offline_get_state(path);
+	if(state == NULL)
+		return;
+	if(gfalfs_offline_errno_counts(errcode) == FALSE && usec < (gint64) gfalfs_get_offline_timeout() * G_USEC_PER_SEC){
+		g_atomic_int_set(&(state->failures), 0);
+		return;
+	}
+	const gint failures = g_atomic_int_exchange_and_add(&(state->failures), 1) + 1;
+	if(failures >= (gint) gfalfs_get_offline_errors() && g_atomic_int_compare_and_exchange(&(state->offline), 0, 1)){
+		GError* tmp_err = NULL;
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_offline storage of %s unavailable after %d failures, last err %d, serve from the caches",
+					state->root, failures, errcode);
+		if(g_thread_create(gfalfs_offline_probe, state, FALSE, &tmp_err) == NULL){
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_offline err : %s", tmp_err->message);
+			g_error_free(tmp_err);
+			g_atomic_int_set(&(state->offline), 0);
+		}
+	}
+}
+
+gboolean gfalfs_offline_active(const char* path){
+	gfalfs_offline_state* state = gfalfs_offline_get_state(path);
+	return state != NULL && g_atomic_int_get(&(state->offline));
+}
@@ -0,0 +1,36 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_offline.h
+ * @brief offline mode, detection of an unavailable storage from the errors
+ * and the latency of the remote operations, the caches are served meanwhile
+ */
+
+#include <errno.h>
+#include <glib.h>
+
+// error of the remote operations not served from the caches while offline
+#define GFALFS_OFFLINE_ERRNO EHOSTDOWN
+
+// prepare the state of each mounted url, to call once the mount table is loaded
+void gfalfs_offline_init();
+
+// account the result of a remote operation on a local path, errcode is 0 for a success
+void gfalfs_offline_report(const char* path, int errcode, gint64 usec);
+
+// TRUE while the storage of a local path is considered unavailable
+gboolean gfalfs_offline_active(const char* path);
@@ -23,12 +23,23 @@
 
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include <gfal_api.h>
 
 
 #include "gfal_opers.h"
 #include "gfal_ext.h"
+#include "gfal_cache.h"
+#include "gfal_crawler.h"
+#include "gfal_staging.h"
+#include "gfal_readahead.h"
+#include "gfal_blockcache.h"
+#include "gfal_control.h"
+#include "gfal_mounts.h"
+#include "gfal_offline.h"
+#include "gfal_deadline.h"
+#include "gfal_bulk.h"
 
 char mount_point[2048]; 
 size_t s_mount_point=0;
@@ -49,7 +60,9 @@ void gfalfs_set_remote_mount_point(const char* remote_mp){
 }
 
 void gfalfs_construct_path(const char* path, char* buff, size_t s_buff){
-	if(guid_mode){
+	if(gfalfs_mounts_enabled()){
+		gfalfs_mounts_construct_path(path, buff, s_buff);
+	}else if(guid_mode){
 		g_strlcpy(buff, path+1, s_buff);
 	}else{
 		 char* p = (char*) mempcpy(buff, mount_point, MIN(s_buff-1, s_mount_point));
@@ -58,30 +71,45 @@ void gfalfs_construct_path(const char* path, char* buff, size_t s_buff){
 	}
 }
 
+gboolean gfalfs_local_path_from_abs(const char* abs_path, char* buff, size_t s_buff){
+	if(s_local_mount_point == 0 || strncmp(abs_path, local_mount_point, s_local_mount_point) != 0)
+		return FALSE;
+	const char* p = abs_path + s_local_mount_point;
+	if(*p != '/' && *p != '\0') // an other directory with the same prefix
+		return FALSE;
+	g_strlcpy(buff, (*p == '\0')?"/":p, s_buff);
+	return TRUE;
+}
+
+// convert a symlink target, an absolute path of the mount becomes an url, the others are kept
 void gfalfs_construct_path_from_abs_local(const char* path, char* buff, size_t s_buff){
 	char tmp_buff[2048];
-	if(strstr(path, local_mount_point)== (char*)path){
-		g_strlcpy(tmp_buff, path + s_local_mount_point, 2048);
+	if(gfalfs_local_path_from_abs(path, tmp_buff, 2048))
+		gfalfs_construct_path(tmp_buff, buff, s_buff);
+	else
+		g_strlcpy(buff, path, s_buff);
+}
+
+// convert the target of a remote link to a local path, the targets outside of the remote mount point are kept
+static void convert_external_readlink_to_local_readlink(const char* target, char* local_buff, size_t s_local){
+	char path_buff[2048];
+	const char* rel = NULL;
+	if(gfalfs_mounts_enabled()){
+		if(gfalfs_mounts_url_to_path(target, path_buff, 2048))
+			rel = path_buff;
+	}else if(guid_mode == FALSE && s_mount_point > 0 && strncmp(target, mount_point, s_mount_point) == 0){
+		rel = target + s_mount_point;
+		if(*rel != '/' && *rel != '\0' && mount_point[s_mount_point-1] != '/') // an other directory with the same prefix
+			rel = NULL;
 	}
-	gfalfs_construct_path(tmp_buff, buff, s_buff);
-}
-
-// convert a remote path of result in a local path
-static void convert_external_readlink_to_local_readlink(char* external_buff, size_t s_ext, char* local_buff, ssize_t s_local){ 
-	if( s_local > 0){	
-			char internal_buff[2048];
-			if(s_ext > s_mount_point){
-				size_t s_input = MIN(s_ext, 2048-1);
-				*((char*)mempcpy(internal_buff, external_buff+s_mount_point , s_input-s_mount_point )) = '\0';
-		
-				g_strlcpy(local_buff,local_mount_point, s_local );
-				if(s_local > s_local_mount_point)
-					g_strlcat(local_buff, internal_buff , s_local);
-			}else{
-				*((char*)mempcpy(local_buff, external_buff, MIN(s_ext, s_local-1) )) = '\0';
-			}
-		
+	if(rel == NULL){
+		g_strlcpy(local_buff, target, s_local);
+		return;
 	}
+	g_strlcpy(local_buff, local_mount_point, s_local);
+	if(*rel != '\0' && *rel != '/')
+		g_strlcat(local_buff, "/", s_local);
+	g_strlcat(local_buff, rel, s_local);
 }
 
 
@@ -91,16 +119,31 @@ static int gfalfs_getattr(const char *path, struct stat *stbuf)
 	char buff[2048];
 	char err_buff[1024];
 	int ret=-1;
+	if(gfalfs_mounts_enabled() && gfalfs_mounts_is_root(path)){
+		gfalfs_mounts_root_stat(stbuf);
+		return 0;
+	}
+	if(gfalfs_bulk_pending(path)) // queued unlink
+		return -(ENOENT);
+	if(gfalfs_get_staging_mode() && gfalfs_staging_getattr(path, stbuf) == 0)
+		return 0;
+	if(gfalfs_cache_get_stat(path, stbuf))
+		return 0;
 	gfalfs_construct_path(path, buff, 2048);
+	if(*buff == '\0') // not under a declared mount
+		return -(ENOENT);
+	if(gfalfs_offline_active(path))
+		return (gfalfs_cache_peek_stat(path, stbuf))?0:-(GFALFS_OFFLINE_ERRNO);
 	if(fuse_interrupted())
 		return -(ECANCELED);
-    int a= gfal_lstat(buff, stbuf);
-    if( (ret = -(gfal_posix_code_error()))){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_getattr error %d for path %s: %s ", (int) gfal_posix_code_error(), (char*)buff, (char*)gfal_posix_strerror_r(err_buff, 1024));
-		gfal_posix_clear_error();
+	const gint64 start = g_get_monotonic_time();
+    int a= gfalfs_timed_lstat(buff, stbuf, err_buff, 1024);
+	gfalfs_offline_report(path, -a, g_get_monotonic_time() - start);
+    if( (ret = a) < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_getattr error %d for path %s: %s ", (int) -ret, (char*)buff, (char*)err_buff);
 		return ret;
     }else{
-        gfalfs_tune_stat(stbuf);
+        gfalfs_record_stat(path, buff, stbuf);
     }
 	if(fuse_interrupted())
 		return -(ECANCELED);
@@ -113,15 +156,25 @@ static int gfalfs_readlink(const char *path, char* link_buff, size_t buffsiz)
 	char buff[2048];
 	char err_buff[1024];
 	char tmp_link_buff[2048];
+	char local_link_buff[2048];
 	int ret=-1;
+	if(buffsiz == 0)
+		return -(EINVAL);
+	if(gfalfs_cache_get_link(path, link_buff, buffsiz))
+		return 0;
 	gfalfs_construct_path(path, buff, 2048);
-    ssize_t a= gfal_readlink(buff, tmp_link_buff, 2048-1);
-	convert_external_readlink_to_local_readlink(tmp_link_buff, a, link_buff, buffsiz );
-    if( (ret = -(gfal_posix_code_error()))){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_readlink error %d for path %s: %s ", (int) gfal_posix_code_error(), (char*)buff, (char*)gfal_posix_strerror_r(err_buff, 1024));
-		gfal_posix_clear_error();
+	if(gfalfs_offline_active(path))
+		return (gfalfs_cache_peek_link(path, link_buff, buffsiz))?0:-(GFALFS_OFFLINE_ERRNO);
+    ssize_t a= gfalfs_timed_readlink(buff, tmp_link_buff, 2048-1, err_buff, 1024);
+    if(a < 0){
+		ret = a;
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_readlink error %d for path %s: %s ", -ret, (char*)buff, (char*)err_buff);
 		return ret;
 	}
+	tmp_link_buff[MIN(a, 2048-1)] = '\0';
+	convert_external_readlink_to_local_readlink(tmp_link_buff, local_link_buff, 2048);
+	gfalfs_cache_set_link(path, local_link_buff);
+	g_strlcpy(link_buff, local_link_buff, buffsiz);
 	if(fuse_interrupted())
 		return -(ECANCELED);
     return 0;
@@ -133,16 +186,37 @@ static int gfalfs_opendir(const char * path, struct fuse_file_info * f){
 	char err_buff[1024];
 	int ret;
 	gfalfs_construct_path(path, buff, 2048);
-	DIR* i = gfal_opendir(buff);
-    if( (ret= -(gfal_posix_code_error()))){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_opendir err %d for path %s: %s", (int)gfal_posix_code_error(), (char*) buff, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		gfal_posix_clear_error();
-		return ret;	
+	if(gfalfs_mounts_enabled() && gfalfs_mounts_is_root(path)){
+		f->fh= (uint64_t) gfalFS_dir_handle_new_from_listing(gfalfs_mounts_root_listing(), path);
+		return (f->fh)?0:-(ENOMEM);
+	}
+	if( (ret = gfalfs_bulk_wait_tree(path)) < 0)
+		return ret;
+	gfalfs_listing listing = (gfalfs_offline_active(path))?gfalfs_cache_peek_listing(path):gfalfs_cache_get_listing(path);
+	if(listing != NULL){
+		f->fh= (uint64_t) gfalFS_dir_handle_new_from_listing(listing, buff);
+		return (f->fh)?0:-(ENOMEM);
+	}
+	if(gfalfs_offline_active(path))
+		return -(GFALFS_OFFLINE_ERRNO);
+	const guint64 generation = gfalfs_cache_generation();
+	const gint64 start = g_get_monotonic_time();
+	DIR* i = gfalfs_timed_opendir(buff, &ret, err_buff, 1024);
+	gfalfs_offline_report(path, ret, g_get_monotonic_time() - start);
+    if(ret != 0 || i == NULL){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_opendir err %d for path %s: %s", ret, (char*) buff, (char*) err_buff);
+		return (ret)?-(ret):-(EIO);
 	}
-	f->fh= (uint64_t) gfalFS_dir_handle_new((void*)i, buff);
+	gfalFS_dir_handle dir_handle = gfalFS_dir_handle_new((void*)i, buff);
+	if(dir_handle == NULL){
+		gfalfs_timed_closedir(i, err_buff, 1024);
+		return -(ENOMEM);
+	}
+	dir_handle->generation = generation;
+	f->fh= (uint64_t) dir_handle;
 	if(fuse_interrupted())
 		return -(ECANCELED);
-	return (i!= NULL)?0:-(gfal_posix_code_error());
+	return 0;
 }
 
 static int gfalfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
@@ -150,7 +224,37 @@ static int gfalfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 {
 	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_readdir path %s ",(char*) path);
 	
-	return gfalFS_dir_handle_readdir((gfalFS_dir_handle)fi->fh, offset, buf, filler);
+	return gfalFS_dir_handle_readdir((gfalFS_dir_handle)fi->fh, path, offset, buf, filler);
+}
+
+// the kernel cache of a trusted file is still valid if the storage checksum did not change
+static gboolean gfalfs_revalidate_checksum(const char* path, const char* url){
+	char trusted_sum[GFALFS_CHECKSUM_MAX_LEN];
+	char remote_sum[GFALFS_CHECKSUM_MAX_LEN];
+	if(gfalfs_get_checksum_type() == GFALFS_CHECKSUM_NONE
+		|| gfalfs_cache_get_trusted(path, trusted_sum, GFALFS_CHECKSUM_MAX_LEN) == FALSE)
+		return FALSE;
+	if(gfalfs_checksum_remote(url, gfalfs_get_checksum_type(), remote_sum, GFALFS_CHECKSUM_MAX_LEN) == 0
+		&& gfalfs_checksum_equal(trusted_sum, remote_sum)){
+		gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_open %s revalidated by checksum", (char*) path);
+		return TRUE;
+	}
+	gfalfs_cache_set_trusted(path, NULL);
+	return FALSE;
+}
+
+// open a file known by the caches while the storage is unavailable, the remote
+// file is opened by the first read not served from the caches
+static int gfalfs_open_offline(const char* path, const char* url, struct fuse_file_info *fi){
+	struct stat st;
+	if((fi->flags & O_ACCMODE) != O_RDONLY || gfalfs_cache_peek_stat(path, &st) == FALSE)
+		return -(GFALFS_OFFLINE_ERRNO);
+	gfalFS_file_handle handle = gfalFS_file_handle_new(-1, url, path, fi->flags);
+	fi->fh= (uint64_t) handle;
+	fi->keep_cache = 1;
+	if(gfalfs_get_readahead_mode())
+		gfalfs_readahead_open(handle);
+	return 0;
 }
 
 static int gfalfs_open(const char *path, struct fuse_file_info *fi)
@@ -159,15 +263,42 @@ static int gfalfs_open(const char *path, struct fuse_file_info *fi)
 	char err_buff[1024];
 	int ret =-1;
 	gfalfs_construct_path(path, buff, 2048);
-	int i = gfal_open(buff,fi->flags,755);
+	if(gfalfs_offline_active(path))
+		return gfalfs_open_offline(path, buff, fi);
+	if( (ret = gfalfs_bulk_wait_path(path)) < 0)
+		return ret;
+	if(gfalfs_staging_wanted(fi->flags)){
+		gfalFS_file_handle handle = gfalFS_file_handle_new(-1, buff, path, fi->flags);
+		if( (ret = gfalfs_staging_open(handle, !(fi->flags & O_TRUNC))) < 0){
+			gfalFS_file_handle_delete(handle);
+			return ret;
+		}
+		fi->fh= (uint64_t) handle;
+		gfalfs_cache_invalidate(path);
+		return 0;
+	}
+	const gint64 start = g_get_monotonic_time();
+	int i = gfalfs_timed_open(buff,fi->flags,755, err_buff, 1024);
+	gfalfs_offline_report(path, (i < 0)?-i:0, g_get_monotonic_time() - start);
 	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_open path %s %d", (char*) path, (int) i);
-    if( (ret = -(gfal_posix_code_error())) || i==0){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_open err %d for path %s: %s ", (int) gfal_posix_code_error(), (char*)buff, (char*)gfal_posix_strerror_r(err_buff, 1024));
-		gfal_posix_clear_error();
-		return ret;	
+    if( (ret = i) < 0 || i==0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_open err %d for path %s: %s ", (int) -ret, (char*)buff, (char*)err_buff);
+		return (ret < 0)?ret:-(EIO);
 	}
 	
-	fi->fh= i;
+	gfalFS_file_handle handle = gfalFS_file_handle_new(i, buff, path, fi->flags);
+	fi->fh= (uint64_t) handle;
+	if(gfalfs_cache_enabled()){
+		if((fi->flags & O_ACCMODE) == O_RDONLY)
+			fi->keep_cache = gfalfs_cache_open_unchanged(path) || gfalfs_revalidate_checksum(path, buff);
+		else
+			gfalfs_cache_invalidate(path);
+	}
+	if((fi->flags & O_ACCMODE) == O_RDONLY){
+		gfalFS_file_handle_verify_start(handle);
+		if(gfalfs_get_readahead_mode())
+			gfalfs_readahead_open(handle);
+	}
 	if(fuse_interrupted())
 		return -(ECANCELED);
 	return 0;
@@ -177,15 +308,31 @@ static int gfalfs_creat (const char * path, mode_t mode , struct fuse_file_info
 	char buff[2048];
 	char err_buff[1024];
 	int ret =-1;
+	if(gfalfs_mounts_enabled() && (ret = gfalfs_mounts_check_change(path)) < 0)
+		return ret;
 	gfalfs_construct_path(path, buff, 2048);
-	int i = gfal_creat(buff,mode);
+	if(gfalfs_offline_active(path))
+		return -(GFALFS_OFFLINE_ERRNO);
+	if( (ret = gfalfs_bulk_wait_path(path)) < 0)
+		return ret;
+	gfalfs_cache_invalidate(path);
+	if(gfalfs_staging_wanted(fi->flags | O_WRONLY)){ // the remote file is created by the upload
+		gfalFS_file_handle handle = gfalFS_file_handle_new(-1, buff, path, fi->flags | O_CREAT);
+		handle->mode = mode;
+		if( (ret = gfalfs_staging_open(handle, FALSE)) < 0){
+			gfalFS_file_handle_delete(handle);
+			return ret;
+		}
+		fi->fh= (uint64_t) handle;
+		return 0;
+	}
+	int i = gfalfs_timed_creat(buff, mode, err_buff, 1024);
 	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_open path %s %d", (char*) path, (int) i);
-    if((ret = -(gfal_posix_code_error())) || i==0){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_open err %d for path %s: %s ", (int) gfal_posix_code_error(), (char*)buff, (char*)gfal_posix_strerror_r(err_buff, 1024));
-		gfal_posix_clear_error();
+    if( (ret = i) < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_open err %d for path %s: %s ", (int) -ret, (char*)buff, (char*)err_buff);
 		return ret;	
 	}	
-	fi->fh= i;
+	fi->fh= (uint64_t) gfalFS_file_handle_new(i, buff, path, fi->flags);
 	if(fuse_interrupted())
 		return -(ECANCELED);
 	return 0;	
@@ -207,26 +354,43 @@ int gfalfs_utimens (const char * path, const struct timespec tv[2]){
 }
 
 int gfalfs_truncate (const char * path, off_t size){
-	// do nothing, not implemented yet
 	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_truncate path : %s ", (char*) path);
 	gfal_posix_clear_error();
+	if(gfalfs_get_staging_mode()){
+		const int ret = gfalfs_staging_truncate_path(path, size);
+		if(ret != -(ENOENT))
+			return ret;
+	}
+	// do nothing, not implemented yet
 	return 0;	
 }
 
+int gfalfs_ftruncate (const char * path, off_t size, struct fuse_file_info * fi){
+	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_ftruncate path : %s ", (char*) path);
+	gfalFS_file_handle handle = (gfalFS_file_handle) fi->fh;
+	if(gfalFS_file_handle_is_staged(handle))
+		return gfalfs_staging_truncate(handle, size);
+	// do nothing, not implemented yet
+	return 0;
+}
+
 
 static int gfalfs_read(const char *path, char *buf, size_t size, off_t offset,
                       struct fuse_file_info *fi)
 {
-	char err_buff[1024];
 	int ret = 0;
-	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_read path : %s fd : %d", (char*) path, (int) fi->fh);
+	gfalFS_file_handle handle = (gfalFS_file_handle) fi->fh;
+	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_read path : %s fd : %d", (char*) path, gfalFS_file_handle_get_fd(handle));
+	if(gfalFS_file_handle_is_staged(handle))
+		return gfalfs_staging_read(handle, buf, size, offset);
 	
-	ret = gfal_pread(GPOINTER_TO_INT(fi->fh),(void*)buf, size, offset);
-	if(ret <0 ){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_pread err %d for path %s: %s ", (int) gfal_posix_code_error(), (char*) path, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(gfal_posix_code_error());
-		gfal_posix_clear_error();
+	if(gfalfs_get_readahead_mode() && (handle->flags & O_ACCMODE) == O_RDONLY){
+		ret = gfalfs_readahead_read(handle, buf, size, offset);
+	}else{
+		ret = gfalFS_file_handle_pread(handle, buf, size, offset);
 	}
+	if(ret >= 0)
+		gfalFS_file_handle_verify(handle, buf, offset, ret, size);
 	
 	if(fuse_interrupted())
 		return -(ECANCELED);
@@ -237,16 +401,17 @@ static int gfalfs_read(const char *path, char *buf, size_t size, off_t offset,
 static int gfalfs_write(const char *path, const char *buf, size_t size, off_t offset,
                       struct fuse_file_info *fi)
 {
-	char err_buff[1024];
 	int ret = 0;
-	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_write path : %s fd : %d", (char*) path, (int) fi->fh);
+	gfalFS_file_handle handle = (gfalFS_file_handle) fi->fh;
+	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_write path : %s fd : %d", (char*) path, gfalFS_file_handle_get_fd(handle));
+	if(gfalFS_file_handle_is_staged(handle))
+		return gfalfs_staging_write(handle, buf, size, offset);
 	
-	ret = gfal_pwrite(GPOINTER_TO_INT(fi->fh),(void*)buf, size, offset);
-	if(ret <0 ){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_pwrite err %d for path %s: %s ", (int) gfal_posix_code_error(), (char*) path, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(gfal_posix_code_error());
-		gfal_posix_clear_error();
-	}
+	if(gfalfs_get_readahead_mode() && g_atomic_int_compare_and_exchange(&(handle->cached_dropped), 0, 1))
+		gfalfs_blockcache_drop_file(handle->file_id);
+	ret = gfalFS_file_handle_pwrite(handle, buf, size, offset);
+	if(ret > 0) // size and mtime changed
+		gfalfs_cache_invalidate_stat(path);
 	
 	if(fuse_interrupted())
 		return -(ECANCELED);
@@ -261,12 +426,14 @@ static int gfalfs_access(const char * path, int flag){
 	char err_buff[1024];
 	int ret;
 	
+	if(gfalfs_mounts_enabled() && gfalfs_mounts_is_root(path))
+		return (flag & W_OK)?-(EACCES):0;
 	gfalfs_construct_path(path, buff, 2048);	
-	int i = gfal_access(buff, flag);
-	if( i < 0){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_access err %d for path %s: %s ", (int)gfal_posix_code_error(), (char*) buff, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(gfal_posix_code_error());
-		gfal_posix_clear_error();	
+	if(gfalfs_offline_active(path))
+		return -(GFALFS_OFFLINE_ERRNO);
+	int i = gfalfs_timed_access(buff, flag, err_buff, 1024);
+	if( (ret = i) < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_access err %d for path %s: %s ", (int) -ret, (char*) buff, (char*) err_buff);
 		return ret;
 	}
 	if(fuse_interrupted())
@@ -281,12 +448,21 @@ static int gfalfs_unlink(const char * path){
 	char err_buff[1024];
 	int ret;
 	
+	if(gfalfs_mounts_enabled() && (ret = gfalfs_mounts_check_change(path)) < 0)
+		return ret;
 	gfalfs_construct_path(path, buff, 2048);	
-	int i = gfal_unlink(buff);
-	if( i < 0){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_access err %d for path %s: %s ", (int)gfal_posix_code_error(), (char*) buff, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(gfal_posix_code_error());
-		gfal_posix_clear_error();	
+	if(gfalfs_offline_active(path))
+		return -(GFALFS_OFFLINE_ERRNO);
+	if(gfalfs_bulk_enabled()){
+		gfalfs_cache_invalidate(path);
+		if( (ret = gfalfs_bulk_unlink(path, buff)) < 0)
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_unlink err %d for path %s", (int) -ret, (char*) buff);
+		return ret;
+	}
+	int i = gfalfs_timed_unlink(buff, err_buff, 1024);
+	gfalfs_cache_invalidate(path);
+	if( (ret = i) < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_access err %d for path %s: %s ", (int) -ret, (char*) buff, (char*) err_buff);
 		return ret;
 	}
 	if(fuse_interrupted())
@@ -300,15 +476,20 @@ static int gfalfs_mkdir(const char * path, mode_t mode){
 	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_mkdir path : %s ", (char*) path);	
 	char buff_path[2048];
 	char err_buff[1024];
+	int ret;	
 	
+	if(gfalfs_mounts_enabled() && (ret = gfalfs_mounts_check_change(path)) < 0)
+		return ret;
 	gfalfs_construct_path(path, buff_path, 2048);
-	int ret;	
-	int i = gfal_mkdir(buff_path, mode);
-	if( i < 0){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_mkdir err %d for path %s: %s ", (int) gfal_posix_code_error(), (char*) buff_path, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(gfal_posix_code_error());
-		gfal_posix_clear_error();	
-		return ret;	
+	if(gfalfs_offline_active(path))
+		return -(GFALFS_OFFLINE_ERRNO);
+	if( (ret = gfalfs_bulk_wait_path(path)) < 0)
+		return ret;
+	int i = gfalfs_timed_mkdir(buff_path, mode, err_buff, 1024);
+	gfalfs_cache_invalidate(path);
+	if( (ret = i) < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_mkdir err %d for path %s: %s ", (int) -ret, (char*) buff_path, (char*) err_buff);
+		return ret;
 	}
 	if(fuse_interrupted())
 		return -(ECANCELED);
@@ -320,18 +501,21 @@ static int gfalfs_getxattr (const char * path, const char *name , char *buff, si
 	char buff_path[2048];
 	char err_buff[1024];
 	
+	if(gfalfs_control_is_xattr(name))
+		return gfalfs_control_getxattr(path, name, buff, s_buff);
 	gfalfs_construct_path(path, buff_path, 2048);
+	if(gfalfs_offline_active(path))
+		return -(GFALFS_OFFLINE_ERRNO);
 	int ret;	
-	int i = gfal_getxattr(buff_path, name, buff, s_buff);
+	int i = gfalfs_timed_getxattr(buff_path, name, buff, s_buff, err_buff, 1024);
 	if( i < 0 ){
-        int errcode = gfal_posix_code_error();
+        int errcode = -i;
         if(errcode == EPROTONOSUPPORT) // silent the non supported errors
             errcode = ENOATTR;
 
 		if(errcode != ENOATTR) // suppress verbose error for ENOATTR for perfs reasons
-			gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_getxattr err %d for path %s: %s ", (int) errcode, (char*) buff_path, (char*) gfal_posix_strerror_r(err_buff, 1024));
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_getxattr err %d for path %s: %s ", (int) errcode, (char*) buff_path, (char*) err_buff);
 		ret = -(errcode);
-		gfal_posix_clear_error();	
 		return ret;	
 	}
 	if(fuse_interrupted())
@@ -344,16 +528,17 @@ static int gfalfs_setxattr (const char * path, const char *name , const char *bu
 	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_setxattr path : %s, name : %s", (char*) path, (char*) name);	
 	char buff_path[2048];
 	char err_buff[1024];
+	if(gfalfs_control_is_xattr(name))
+		return gfalfs_control_setxattr(path, name, buff, s_buff);
 	gfalfs_construct_path(path, buff_path, 2048);
+	if(gfalfs_offline_active(path))
+		return -(GFALFS_OFFLINE_ERRNO);
 	
 	
 	int ret;	
-	int i = gfal_setxattr(buff_path, name, buff, s_buff, flag);
-	if( i < 0 ){
-		const int errcode = gfal_posix_code_error();
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_setxattr err %d for path %s: %s ", (int) errcode, (char*) buff_path, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(errcode);
-		gfal_posix_clear_error();	
+	int i = gfalfs_timed_setxattr(buff_path, name, buff, s_buff, flag, err_buff, 1024);
+	if( (ret = i) < 0 ){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_setxattr err %d for path %s: %s ", (int) -ret, (char*) buff_path, (char*) err_buff);
 		return ret;	
 	}
 	if(fuse_interrupted())
@@ -367,14 +552,14 @@ static int gfalfs_listxattr (const char * path, char *list, size_t s_list){
 	char buff_path[2048];
 	char err_buff[1024];
 	gfalfs_construct_path(path, buff_path, 2048);
+	if(gfalfs_offline_active(path))
+		return -(GFALFS_OFFLINE_ERRNO);
 	
 	
 	int ret;	
-	int i = gfal_listxattr(buff_path, list, s_list);
-	if( i < 0){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_listxattr err %d for path %s: %s ", (int) gfal_posix_code_error(), (char*) buff_path, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(gfal_posix_code_error());
-		gfal_posix_clear_error();	
+	int i = gfalfs_timed_listxattr(buff_path, list, s_list, err_buff, 1024);
+	if( (ret = i) < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_listxattr err %d for path %s: %s ", (int) -ret, (char*) buff_path, (char*) err_buff);
 		return ret;	
 	}
 	if(fuse_interrupted())
@@ -389,14 +574,22 @@ static int gfalfs_rename(const char*oldpath, const char* newpath){
 	char err_buff[1024];
 	
 	int ret;
+	if(gfalfs_mounts_enabled() && (ret = gfalfs_mounts_check_rename(oldpath, newpath)) < 0)
+		return ret;
 	gfalfs_construct_path(oldpath, buff_oldpath, 2048);	
 	gfalfs_construct_path(newpath, buff_newpath, 2048);	
-	int i = gfal_rename(buff_oldpath, buff_newpath);
-	if( i < 0){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_rename err %d for oldpath %s: %s ", (int) gfal_posix_code_error(), (char*) buff_oldpath, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(gfal_posix_code_error());
-		gfal_posix_clear_error();
-		return ret;		
+	if(gfalfs_offline_active(newpath))
+		return -(GFALFS_OFFLINE_ERRNO);
+	if( (ret = gfalfs_bulk_wait_tree(oldpath)) < 0)
+		return ret;
+	if( (ret = gfalfs_bulk_wait_path(newpath)) < 0)
+		return ret;
+	int i = gfalfs_timed_rename(buff_oldpath, buff_newpath, err_buff, 1024);
+	gfalfs_cache_invalidate_tree(oldpath);
+	gfalfs_cache_invalidate_tree(newpath);
+	if( (ret = i) < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_rename err %d for oldpath %s: %s ", (int) -ret, (char*) buff_oldpath, (char*) err_buff);
+		return ret;
 	}
 	if(fuse_interrupted())
 		return -(ECANCELED);
@@ -410,14 +603,19 @@ static int gfalfs_symlink(const char*oldpath, const char* newpath){
 	char err_buff[1024];
 	int ret;
 	
+	if(gfalfs_mounts_enabled() && (ret = gfalfs_mounts_check_change(newpath)) < 0)
+		return ret;
 	gfalfs_construct_path_from_abs_local(oldpath, buff_oldpath, 2048);	
 	gfalfs_construct_path(newpath, buff_newpath, 2048);	
+	if(gfalfs_offline_active(newpath))
+		return -(GFALFS_OFFLINE_ERRNO);
 	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_symlink oldpath : %s, newpath : %s ", (char*) buff_oldpath, (char*) buff_newpath);	
-	int i = gfal_symlink(buff_oldpath, buff_newpath);
-	if( i < 0){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_symlink err %d for oldpath %s: %s ", (int) gfal_posix_code_error(), (char*) buff_oldpath, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(gfal_posix_code_error());
-		gfal_posix_clear_error();
+	if( (ret = gfalfs_bulk_wait_path(newpath)) < 0)
+		return ret;
+	int i = gfalfs_timed_symlink(buff_oldpath, buff_newpath, err_buff, 1024);
+	gfalfs_cache_invalidate(newpath);
+	if( (ret = i) < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_symlink err %d for oldpath %s: %s ", (int) -ret, (char*) buff_oldpath, (char*) err_buff);
 		return ret;		
 	}
 	if(fuse_interrupted())
@@ -425,17 +623,36 @@ static int gfalfs_symlink(const char*oldpath, const char* newpath){
 	return i;	
 }
 
+static int gfalfs_flush(const char* path, struct fuse_file_info *fi){
+	gfalFS_file_handle handle = (gfalFS_file_handle) fi->fh;
+	// report the upload errors to close()
+	if(gfalFS_file_handle_is_staged(handle))
+		return gfalfs_staging_upload(handle);
+	return 0;
+}
+
 static int gfalfs_release(const char* path, struct fuse_file_info *fi){
-	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_close fd : %d", (int) fi->fh);
+	gfalFS_file_handle handle = (gfalFS_file_handle) fi->fh;
+	int fd = gfalFS_file_handle_get_fd(handle);
+	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_close fd : %d", fd);
 	char err_buff[1024];
-	const int fd = GPOINTER_TO_INT(fi->fh);
+	int i = 0;
 	
-    int i = gfal_close(fd);
-	if(i <0 ){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_close err %d for fd %d: %s ", (int) gfal_posix_code_error(), (int) fi->fh, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		i = -(gfal_posix_code_error());
-		gfal_posix_clear_error();
+	if(gfalFS_file_handle_is_staged(handle)){
+		i = gfalfs_staging_upload(handle);
+		gfalfs_staging_close(handle);
+	}else{
+		if(gfalfs_get_readahead_mode() && (handle->flags & O_ACCMODE) == O_RDONLY)
+			gfalfs_readahead_close(handle);
+		fd = gfalFS_file_handle_get_fd(handle); // may be reopened by a recovery
+		i = (fd >= 0)?gfalfs_timed_close(fd, err_buff, 1024):0; // no descriptor if opened offline and never read remotely
+		if(i <0 )
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_close err %d for fd %d: %s ", -i, fd, (char*) err_buff);
+		if((handle->flags & O_ACCMODE) != O_RDONLY)
+			gfalfs_cache_invalidate(path);
 	}
+	gfalfs_control_account(handle);
+	gfalFS_file_handle_delete(handle);
     return i;	
 }
 
@@ -443,15 +660,12 @@ static int gfalfs_releasedir(const char* path, struct fuse_file_info *fi){
 	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE,"gfalfs_closedir fd : %d", (int) fi->fh);
 	char err_buff[1024];
 	
-	DIR* d = gfalFS_dir_handle_get_fd((void*)fi->fh);
-    int i = gfal_closedir(d);
-    int ret;
-	if(i <0 ){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_closedir err %d for fd %d: %s ", (int) gfal_posix_code_error(), (int) fi->fh, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(gfal_posix_code_error());
-		gfal_posix_clear_error();
-		return ret;
-	}
+	gfalFS_dir_handle handle = (gfalFS_dir_handle) fi->fh;
+	DIR* d = gfalFS_dir_handle_get_fd(handle);
+    int i = (d != NULL)?gfalfs_timed_closedir(d, err_buff, 1024):0; // no remote descriptor for a cached listing
+	gfalFS_dir_handle_delete(handle);
+	if(i <0 )
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_closedir err %d for fd %d: %s ", -i, (int) fi->fh, (char*) err_buff);
     return i;	
 }
 
@@ -462,11 +676,12 @@ static int gfalfs_chmod(const char* path, mode_t mode){
 	int ret;
 	
 	gfalfs_construct_path(path, buff_path, 2048);	
-	int i = gfal_chmod(buff_path, mode);
-	if( i < 0){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_chmod err %d for path %s: %s ", (int) gfal_posix_code_error(), (char*) buff_path, (char*) gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(gfal_posix_code_error());
-		gfal_posix_clear_error();
+	if(gfalfs_offline_active(path))
+		return -(GFALFS_OFFLINE_ERRNO);
+	int i = gfalfs_timed_chmod(buff_path, mode, err_buff, 1024);
+	gfalfs_cache_invalidate(path);
+	if( (ret = i) < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_chmod err %d for path %s: %s ", (int) -ret, (char*) buff_path, (char*) err_buff);
 		return ret;			
 	}
 	if(fuse_interrupted())
@@ -481,13 +696,18 @@ static int gfalfs_rmdir(const char* path){
 	char err_buff[1024];
 	int ret;
 	
+	if(gfalfs_mounts_enabled() && (ret = gfalfs_mounts_check_change(path)) < 0)
+		return ret;
 	gfalfs_construct_path(path, buff_path, 2048);	
-	int i = gfal_rmdir(buff_path);
-	if( i < 0){
-		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_rmdir err %d for path %s: %s ", (int) gfal_posix_code_error(),(char*) buff_path, (char*)gfal_posix_strerror_r(err_buff, 1024));
-		ret = -(gfal_posix_code_error());
-		gfal_posix_clear_error();
-		return ret;		
+	if(gfalfs_offline_active(path))
+		return -(GFALFS_OFFLINE_ERRNO);
+	if( (ret = gfalfs_bulk_wait_tree(path)) < 0) // the unlinks of the content first
+		return ret;
+	int i = gfalfs_timed_rmdir(buff_path, err_buff, 1024);
+	gfalfs_cache_invalidate(path);
+	if( (ret = i) < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_rmdir err %d for path %s: %s ", (int) -ret, (char*) buff_path, (char*) err_buff);
+		return ret;
 	}
 	if(fuse_interrupted())
 		return -(ECANCELED);
@@ -496,6 +716,9 @@ static int gfalfs_rmdir(const char* path){
 
 
 int gfalfs_fake_fgetattr (const char * url, struct stat * st, struct fuse_file_info * f){
+	gfalFS_file_handle handle = (gfalFS_file_handle) f->fh;
+	if(handle != NULL && gfalFS_file_handle_is_staged(handle))
+		return gfalfs_staging_fstat(handle, st);
     if(f->flags & O_CREAT && (strncmp(mount_point, "srm",3) ==0 ||strncmp(mount_point, "gsiftp",5) ==0 )){ // tmp hack for srm & gsiftp consistency
 		gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE ," fgetattr create mode, bypass and set to default, speed hack");
 		memset(st,0,sizeof(struct stat));
@@ -507,7 +730,29 @@ int gfalfs_fake_fgetattr (const char * url, struct stat * st, struct fuse_file_i
 	}
 }
 
+static void* gfalfs_init(struct fuse_conn_info *conn){
+#ifdef FUSE_CAP_ATOMIC_O_TRUNC
+	// open with O_TRUNC instead of truncate + open, avoid to download a staged file before to overwrite it
+	if(gfalfs_get_staging_mode())
+		conn->want |= FUSE_CAP_ATOMIC_O_TRUNC;
+#endif
+	gfalfs_offline_init();
+	// threads have to be started after the fuse daemonization
+	if(gfalfs_get_crawl_mode() && gfalfs_mounts_enabled()){
+		guint i;
+		for(i = 0; i < gfalfs_mounts_count(); ++i){
+			char* root = g_strconcat("/", gfalfs_mounts_name(i), NULL);
+			gfalfs_crawler_start(root);
+			g_free(root);
+		}
+	}else if(gfalfs_get_crawl_mode()){
+		gfalfs_crawler_start("/");
+	}
+	return NULL;
+}
+
 struct fuse_operations gfal_oper = {
+    .init = gfalfs_init,
     .getattr	= gfalfs_getattr,
     .readdir	= gfalfs_readdir,
     .opendir	= gfalfs_opendir,
@@ -525,6 +770,8 @@ struct fuse_operations gfal_oper = {
     .chown = gfalfs_chown,
     .utimens = gfalfs_utimens,
     .truncate = gfalfs_truncate,
+    .ftruncate = gfalfs_ftruncate,
+    .flush = gfalfs_flush,
     .symlink= gfalfs_symlink,
     .setxattr = gfalfs_setxattr,
     .getxattr= gfalfs_getxattr,
@@ -29,6 +29,12 @@ void gfalfs_set_local_mount_point(const char* local_mp);
 
 void gfalfs_set_remote_mount_point(const char* remote_mp);
 
+// convert a local path to the corresponding url
+void gfalfs_construct_path(const char* path, char* buff, size_t s_buff);
+
+// local path in the mount of an absolute path, FALSE if outside of the mount
+gboolean gfalfs_local_path_from_abs(const char* abs_path, char* buff, size_t s_buff);
+
 
 extern gboolean guid_mode;
 extern struct fuse_operations gfal_oper;
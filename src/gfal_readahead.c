@@ -0,0 +1,426 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * gfal_readahead.c
+ * access pattern detection (sequential, strided, random) and block prefetching
+ *
+ * sequential and strided reads are served by block aligned remote reads merged
+ * with the next predicted blocks, the following predicted blocks are prefetched
+ * in background, random reads go directly to the storage
+ * */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <gfal_api.h>
+
+#include "gfal_readahead.h"
+#include "gfal_blockcache.h"
+#include "gfal_bufpool.h"
+#include "gfal_deadline.h"
+
+#define GFALFS_PREFETCH_THREADS 4
+// the prefetch of whole paths has its own threads, the releases never wait for it
+#define GFALFS_PREFETCH_PATH_THREADS 2
+
+typedef struct _gfalfs_prefetch_task{
+	gfalFS_file_handle handle; // NULL for the prefetch of a whole path
+	off_t start;
+	size_t len;
+	char* local_path;
+} gfalfs_prefetch_task;
+
+static GStaticMutex readahead_mutex = G_STATIC_MUTEX_INIT;
+static GThreadPool* prefetch_pool = NULL;
+static GThreadPool* path_pool = NULL;
+static guint64 stat_reads = 0;
+static guint64 stat_cache_hits = 0;
+static guint64 stat_remote_reads = 0;
+static volatile gint path_prefetch_pending = 0;
+
+static const char* pattern_names[] = { "random", "sequential", "strided" };
+
+
+static off_t gfalfs_block_floor(off_t offset){
+	return offset - (offset % gfalfs_get_block_size());
+}
+
+static off_t gfalfs_block_ceil(off_t offset){
+	return gfalfs_block_floor(offset + gfalfs_get_block_size() - 1);
+}
+
+static void gfalfs_pattern_update(gfalfs_read_pattern* pattern, off_t offset, size_t size){
+	if(pattern->reads > 0){
+		pattern->sequential_run = (offset == pattern->last_offset + (off_t) pattern->last_size)?(pattern->sequential_run+1):0;
+		const off_t delta = offset - pattern->last_offset;
+		if(delta != 0 && delta == pattern->stride){
+			pattern->strided_run += 1;
+		}else{
+			pattern->stride = delta;
+			pattern->strided_run = 0;
+		}
+	}
+	pattern->last_offset = offset;
+	pattern->last_size = size;
+	pattern->reads += 1;
+	if(pattern->sequential_run > 0)
+		pattern->type = GFALFS_PATTERN_SEQUENTIAL;
+	else if(pattern->strided_run > 0)
+		pattern->type = GFALFS_PATTERN_STRIDED;
+	else
+		pattern->type = GFALFS_PATTERN_RANDOM;
+}
+
+static ssize_t gfalfs_readahead_fetch(gfalFS_file_handle handle, char* buffer, off_t start, size_t len){
+	return gfalFS_file_handle_pread(handle, buffer, len, start);
+}
+
+// size of the file, -1 if unknown
+static off_t gfalfs_readahead_file_size(gfalFS_file_handle handle){
+	struct stat st;
+	if(handle->size >= 0)
+		return handle->size;
+	return (gfalfs_cache_peek_stat(handle->local_path, &st))?st.st_size:-1;
+}
+
+// split a block aligned range in blocks, the blocks outside of [req_start, req_end) are prefetched ones
+// a short read marks the end of the file only at its known size, a partial tail is not cached
+static void gfalfs_readahead_store(gfalFS_file_handle handle, const char* buffer, off_t start, size_t len, size_t fetched,
+									off_t req_start, off_t req_end){
+	const size_t bs = gfalfs_get_block_size();
+	const gboolean eof = (fetched < len && gfalfs_readahead_file_size(handle) == start + (off_t) fetched);
+	size_t pos;
+	for(pos = 0; pos < fetched; pos += bs){
+		const size_t n = MIN(bs, fetched - pos);
+		const off_t block_start = start + pos;
+		if(n < bs && !eof)
+			break;
+		const gboolean prefetched = !(block_start < req_end && block_start + (off_t) n > req_start);
+		gfalfs_blockcache_insert(handle->file_id, block_start / bs, buffer + pos, n, prefetched);
+	}
+	if(eof && (fetched % bs) == 0) // end of file on a block boundary
+		gfalfs_blockcache_insert(handle->file_id, (start + fetched) / bs, buffer, 0, FALSE);
+}
+
+static size_t gfalfs_readahead_from_cache(gfalFS_file_handle handle, char* buf, size_t size, off_t offset, gboolean* eof){
+	const size_t bs = gfalfs_get_block_size();
+	size_t done = 0;
+	*eof = FALSE;
+	while(done < size){
+		const off_t pos = offset + done;
+		const ssize_t r = gfalfs_blockcache_read(handle->file_id, pos / bs, buf + done, pos % bs, size - done, eof);
+		if(r < 0)
+			break;
+		done += r;
+		if(*eof)
+			break;
+	}
+	return done;
+}
+
+static void gfalfs_prefetch_path_push(const char* local_path);
+
+// TRUE if the cache has room for one more block without eviction
+static gboolean gfalfs_prefetch_has_room(){
+	guint64 used, pinned;
+	gfalfs_blockcache_get_usage(&used, &pinned);
+	return used + gfalfs_get_block_size() <= gfalfs_get_cache_size();
+}
+
+// load a whole file in the free space of the block cache, the cached blocks of the other files are not evicted
+// the reads go through a file handle, with the deadlines and the recovery of the transient errors
+static void gfalfs_prefetch_file(const char* local_path, const char* url, const struct stat* st){
+	char err_buff[1024];
+	const guint64 file_id = gfalfs_path_ino(local_path);
+	const size_t bs = gfalfs_get_block_size();
+	off_t pos;
+	gfalFS_file_handle handle = NULL;
+	char* buffer = NULL;
+
+	gfalfs_blockcache_set_file(file_id, st->st_mtime, st->st_size, NULL);
+	for(pos = 0; pos < st->st_size && gfalfs_prefetch_has_room(); pos += bs){
+		if(gfalfs_blockcache_contains(file_id, pos / bs))
+			continue;
+		if(handle == NULL){
+			const int fd = gfalfs_timed_open(url, O_RDONLY, 0, err_buff, 1024);
+			if(fd < 0){
+				gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_prefetch open err %d for path %s: %s ", -fd, (char*) url, (char*) err_buff);
+				break;
+			}
+			handle = gfalFS_file_handle_new(fd, url, local_path, O_RDONLY);
+			if( (buffer = gfalfs_buffer_alloc(bs)) == NULL)
+				break;
+		}
+		const ssize_t r = gfalFS_file_handle_pread(handle, buffer, bs, pos);
+		if(r < 0) // logged by the handle
+			break;
+		if((size_t) r < bs && pos + r != st->st_size) // changed since the stat
+			break;
+		gfalfs_blockcache_insert(file_id, pos / bs, buffer, r, TRUE);
+		if((size_t) r < bs)
+			break;
+	}
+	if(handle != NULL){
+		gfalfs_timed_close(gfalFS_file_handle_get_fd(handle), err_buff, 1024); // the last descriptor of a reopen
+		gfalFS_file_handle_delete(handle);
+	}
+	gfalfs_buffer_free(buffer);
+}
+
+// prefetch the files of a directory, sub-directories are not followed
+static void gfalfs_prefetch_dir(const char* local_path, const char* url){
+	char err_buff[1024];
+	struct dirent* dir;
+	DIR* d = gfal_opendir(url);
+	if(d == NULL){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_prefetch opendir err %d for path %s: %s", (int)gfal_posix_code_error(), (char*) url, (char*) gfal_posix_strerror_r(err_buff, 1024));
+		gfal_posix_clear_error();
+		return;
+	}
+	while( (dir = gfal_readdir(d)) != NULL){
+		if(dir->d_type != DT_REG && dir->d_type != DT_UNKNOWN)
+			continue;
+		char* child = (strcmp(local_path, "/") == 0)?g_strconcat("/", dir->d_name, NULL):g_strconcat(local_path, "/", dir->d_name, NULL);
+		gfalfs_prefetch_path_push(child);
+		g_free(child);
+	}
+	gfal_posix_clear_error();
+	gfal_closedir(d);
+	gfal_posix_clear_error();
+}
+
+static void gfalfs_prefetch_path_worker(gfalfs_prefetch_task* task){
+	char url[GFALFS_URL_MAX_LEN];
+	struct stat st;
+	gfalfs_construct_path(task->local_path, url, GFALFS_URL_MAX_LEN);
+	if(gfal_lstat(url, &st) == 0){
+		gfalfs_record_stat(task->local_path, url, &st);
+		if(S_ISDIR(st.st_mode))
+			gfalfs_prefetch_dir(task->local_path, url);
+		else if(S_ISREG(st.st_mode))
+			gfalfs_prefetch_file(task->local_path, url, &st);
+	}
+	gfal_posix_clear_error();
+	g_atomic_int_add(&path_prefetch_pending, -1);
+	g_free(task->local_path);
+	g_free(task);
+}
+
+static void gfalfs_prefetch_worker(gpointer data, gpointer user_data){
+	gfalfs_prefetch_task* task = (gfalfs_prefetch_task*) data;
+	gfalFS_file_handle handle = task->handle;
+	gfalfs_deadline_background_thread();
+	if(handle == NULL){
+		gfalfs_prefetch_path_worker(task);
+		return;
+	}
+
+	g_mutex_lock(handle->mut);
+	const gboolean closing = handle->closing;
+	g_mutex_unlock(handle->mut);
+	char* buffer = (closing)?NULL:gfalfs_buffer_alloc(task->len);
+	if(buffer != NULL){ // no prefetch without free memory
+		const ssize_t r = gfalfs_readahead_fetch(handle, buffer, task->start, task->len);
+		if(r >= 0)
+			gfalfs_readahead_store(handle, buffer, task->start, task->len, r, -1, -1);
+		gfalfs_buffer_free(buffer);
+	}
+	g_mutex_lock(handle->mut);
+	handle->prefetching -= 1;
+	g_cond_broadcast(handle->cond);
+	g_mutex_unlock(handle->mut);
+	g_free(task);
+}
+
+// prefetch in background the blocks of the next predicted read
+static void gfalfs_readahead_predict(gfalFS_file_handle handle, off_t offset, size_t size){
+	const size_t bs = gfalfs_get_block_size();
+	off_t start, end;
+
+	g_mutex_lock(handle->mut);
+	switch(handle->pattern.type){
+		case GFALFS_PATTERN_SEQUENTIAL:
+			start = gfalfs_block_ceil(offset + size);
+			end = start + gfalfs_get_readahead_blocks() * bs;
+			break;
+		case GFALFS_PATTERN_STRIDED:
+			start = gfalfs_block_floor(offset + handle->pattern.stride);
+			end = gfalfs_block_ceil(offset + handle->pattern.stride + size);
+			break;
+		default:
+			g_mutex_unlock(handle->mut);
+			return;
+	}
+	if(handle->size >= 0)
+		end = MIN(end, gfalfs_block_ceil(handle->size));
+	// skip the blocks already there
+	while(start < end && gfalfs_blockcache_contains(handle->file_id, start / bs))
+		start += bs;
+	if(start < 0 || start >= end || start == handle->pattern.prefetch_offset || handle->closing){
+		g_mutex_unlock(handle->mut);
+		return;
+	}
+	handle->pattern.prefetch_offset = start;
+	handle->prefetching += 1;
+	g_mutex_unlock(handle->mut);
+
+	gfalfs_prefetch_task* task = g_new0(gfalfs_prefetch_task, 1);
+	task->handle = handle;
+	task->start = start;
+	task->len = end - start;
+	g_thread_pool_push(prefetch_pool, task, NULL);
+}
+
+static void gfalfs_prefetch_pool_init(){
+	g_static_mutex_lock(&readahead_mutex);
+	if(prefetch_pool == NULL)
+		prefetch_pool = g_thread_pool_new(gfalfs_prefetch_worker, NULL, GFALFS_PREFETCH_THREADS, FALSE, NULL);
+	if(path_pool == NULL)
+		path_pool = g_thread_pool_new(gfalfs_prefetch_worker, NULL, GFALFS_PREFETCH_PATH_THREADS, FALSE, NULL);
+	g_static_mutex_unlock(&readahead_mutex);
+}
+
+static void gfalfs_prefetch_path_push(const char* local_path){
+	gfalfs_prefetch_task* task = g_new0(gfalfs_prefetch_task, 1);
+	task->local_path = g_strdup(local_path);
+	g_atomic_int_inc(&path_prefetch_pending);
+	g_thread_pool_push(path_pool, task, NULL);
+}
+
+int gfalfs_readahead_prefetch_path(const char* local_path){
+	if(gfalfs_get_readahead_mode() == FALSE) // the block cache is not used
+		return -(ENOTSUP);
+	gfalfs_prefetch_pool_init();
+	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_prefetch request for %s", (char*) local_path);
+	gfalfs_prefetch_path_push(local_path);
+	return 0;
+}
+
+guint gfalfs_readahead_prefetch_pending(){
+	return (guint) g_atomic_int_get(&path_prefetch_pending);
+}
+
+void gfalfs_readahead_open(gfalFS_file_handle handle){
+	char trusted_sum[GFALFS_CHECKSUM_MAX_LEN];
+	char remote_sum[GFALFS_CHECKSUM_MAX_LEN];
+	struct stat st;
+	gfalfs_prefetch_pool_init();
+
+	if(gfalfs_cache_peek_stat(handle->local_path, &st)){
+		handle->size = st.st_size;
+		// the trusted blocks of a changed file are kept if the storage checksum did not change
+		const gboolean revalidate = gfalfs_get_checksum_type() != GFALFS_CHECKSUM_NONE
+				&& gfalfs_blockcache_file_unchanged(handle->file_id, st.st_mtime, st.st_size) == FALSE
+				&& gfalfs_blockcache_get_trusted(handle->file_id, trusted_sum, GFALFS_CHECKSUM_MAX_LEN)
+				&& gfalfs_checksum_remote(handle->path, gfalfs_get_checksum_type(), remote_sum, GFALFS_CHECKSUM_MAX_LEN) == 0;
+		gfalfs_blockcache_set_file(handle->file_id, st.st_mtime, st.st_size, (revalidate)?remote_sum:NULL);
+	}else{ // unknown version of the file, nothing cached can be trusted
+		gfalfs_blockcache_drop_file(handle->file_id);
+	}
+}
+
+int gfalfs_readahead_read(gfalFS_file_handle handle, char* buf, size_t size, off_t offset){
+	const size_t bs = gfalfs_get_block_size();
+	gboolean eof;
+
+	g_mutex_lock(handle->mut);
+	gfalfs_pattern_update(&(handle->pattern), offset, size);
+	const gfalfs_pattern_type type = handle->pattern.type;
+	const off_t stride = handle->pattern.stride;
+	g_mutex_unlock(handle->mut);
+
+	const size_t done = gfalfs_readahead_from_cache(handle, buf, size, offset, &eof);
+	if(done == size || eof){
+		g_mutex_lock(handle->mut);
+		handle->pattern.cache_hits += 1;
+		g_mutex_unlock(handle->mut);
+		gfalfs_readahead_predict(handle, offset, size);
+		return done;
+	}
+
+	const off_t pos = offset + done;
+	const size_t remaining = size - done;
+	g_mutex_lock(handle->mut);
+	handle->pattern.remote_reads += 1;
+	g_mutex_unlock(handle->mut);
+	if(type == GFALFS_PATTERN_RANDOM){
+		const ssize_t r = gfalfs_readahead_fetch(handle, buf + done, pos, remaining);
+		return (r < 0 && done == 0)?r:(done + MAX(r, 0));
+	}
+
+	// block aligned read, merged with the next predicted blocks
+	const off_t start = gfalfs_block_floor(pos);
+	off_t end = gfalfs_block_ceil(offset + size);
+	if(type == GFALFS_PATTERN_SEQUENTIAL){
+		end += gfalfs_get_readahead_blocks() * bs;
+	}else{
+		const off_t next = offset + stride;
+		if(next > offset && gfalfs_block_floor(next) <= end + (off_t) bs)
+			end = MAX(end, gfalfs_block_ceil(next + size));
+	}
+	if(handle->size >= 0)
+		end = MAX(MIN(end, gfalfs_block_ceil(handle->size)), gfalfs_block_ceil(offset + size));
+
+	const size_t len = end - start;
+	char* buffer = gfalfs_buffer_alloc(len);
+	if(buffer == NULL){ // direct read of the request without read-ahead
+		const ssize_t r = gfalfs_readahead_fetch(handle, buf + done, pos, remaining);
+		return (r < 0 && done == 0)?r:(done + MAX(r, 0));
+	}
+	const ssize_t r = gfalfs_readahead_fetch(handle, buffer, start, len);
+	if(r < 0){
+		gfalfs_buffer_free(buffer);
+		return (done == 0)?r:done;
+	}
+	gfalfs_readahead_store(handle, buffer, start, len, r, pos, offset + size);
+	const size_t skip = pos - start;
+	const size_t avail = (r > (ssize_t) skip)?MIN(remaining, r - skip):0;
+	memcpy(buf + done, buffer + skip, avail);
+	gfalfs_buffer_free(buffer);
+
+	gfalfs_readahead_predict(handle, offset, size);
+	return done + avail;
+}
+
+void gfalfs_readahead_close(gfalFS_file_handle handle){
+	guint64 prefetched, prefetch_hits;
+	g_mutex_lock(handle->mut);
+	handle->closing = TRUE;
+	while(handle->prefetching > 0)
+		g_cond_wait(handle->cond, handle->mut);
+	g_mutex_unlock(handle->mut);
+
+	g_static_mutex_lock(&readahead_mutex);
+	stat_reads += handle->pattern.reads;
+	stat_cache_hits += handle->pattern.cache_hits;
+	stat_remote_reads += handle->pattern.remote_reads;
+	g_static_mutex_unlock(&readahead_mutex);
+
+	gfalfs_blockcache_get_stats(&prefetched, &prefetch_hits);
+	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_readahead %s : pattern %s, %lu reads, %lu from cache, %lu remote, prefetch hit rate %lu/%lu",
+				(char*) handle->path, pattern_names[handle->pattern.type],
+				(unsigned long) handle->pattern.reads, (unsigned long) handle->pattern.cache_hits, (unsigned long) handle->pattern.remote_reads,
+				(unsigned long) prefetch_hits, (unsigned long) prefetched);
+}
+
+void gfalfs_readahead_get_stats(guint64* reads, guint64* cache_hits, guint64* remote_reads){
+	g_static_mutex_lock(&readahead_mutex);
+	*reads = stat_reads;
+	*cache_hits = stat_cache_hits;
+	*remote_reads = stat_remote_reads;
+	g_static_mutex_unlock(&readahead_mutex);
+}
@@ -0,0 +1,42 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_readahead.h
+ * @brief access pattern detection and block prefetching for the reads
+ */
+
+#include <glib.h>
+
+#include "gfal_ext.h"
+
+// prepare a handle opened for reading
+void gfalfs_readahead_open(gfalFS_file_handle handle);
+
+// read through the block cache, prefetch the blocks predicted by the access pattern
+int gfalfs_readahead_read(gfalFS_file_handle handle, char* buf, size_t size, off_t offset);
+
+// wait for the pending prefetches of a handle and account its statistics
+void gfalfs_readahead_close(gfalFS_file_handle handle);
+
+// load a file, or the files of a directory, in the block cache in background
+int gfalfs_readahead_prefetch_path(const char* local_path);
+
+// number of files and directories waiting to be prefetched
+guint gfalfs_readahead_prefetch_pending();
+
+// global statistics of the closed handles
+void gfalfs_readahead_get_stats(guint64* reads, guint64* cache_hits, guint64* remote_reads);
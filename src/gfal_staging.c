@@ -0,0 +1,387 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * gfal_staging.c
+ * local write staging for the protocols without random writes
+ * */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gfal_api.h>
+
+#include "gfal_staging.h"
+#include "gfal_cache.h"
+#include "gfal_bufpool.h"
+#include "gfal_deadline.h"
+
+// size of the transfer buffer for download and upload
+#define GFALFS_STAGING_BUFFER_SIZE (1 << 20)
+
+// space used in the spool, protected by spool_mutex
+static GStaticMutex spool_mutex = G_STATIC_MUTEX_INIT;
+static GCond* spool_cond = NULL;
+static guint64 spool_used = 0;
+
+// staged handles by local path
+static GStaticMutex staged_mutex = G_STATIC_MUTEX_INIT;
+static GCond* staged_cond = NULL; // a control operation released its handle
+static GHashTable* staged_table = NULL;
+
+
+gboolean gfalfs_staging_wanted(int flags){
+	return gfalfs_get_staging_mode() && (flags & O_ACCMODE) != O_RDONLY;
+}
+
+// reserve space in the spool, wait for free space up to spool_wait seconds
+static int gfalfs_spool_reserve(guint64 size){
+	int ret = 0;
+	GTimeVal deadline;
+	if(size > gfalfs_get_spool_max())
+		return -(ENOSPC);
+	g_get_current_time(&deadline);
+	g_time_val_add(&deadline, gfalfs_get_spool_wait() * G_USEC_PER_SEC);
+
+	g_static_mutex_lock(&spool_mutex);
+	if(spool_cond == NULL)
+		spool_cond = g_cond_new();
+	while(spool_used + size > gfalfs_get_spool_max()){
+		gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_staging spool full, wait for %lu bytes", (unsigned long) size);
+		if(g_cond_timed_wait(spool_cond, g_static_mutex_get_mutex(&spool_mutex), &deadline) == FALSE
+			&& spool_used + size > gfalfs_get_spool_max()){
+			ret = -(ENOSPC);
+			break;
+		}
+	}
+	if(ret == 0)
+		spool_used += size;
+	g_static_mutex_unlock(&spool_mutex);
+	return ret;
+}
+
+static void gfalfs_spool_release(guint64 size){
+	g_static_mutex_lock(&spool_mutex);
+	spool_used -= MIN(size, spool_used);
+	if(spool_cond != NULL)
+		g_cond_broadcast(spool_cond);
+	g_static_mutex_unlock(&spool_mutex);
+}
+
+// grow the reservation of a handle to cover size bytes and the current spool content
+// the wait for space runs without the handle lock
+static int gfalfs_staging_reserve(gfalFS_file_handle handle, off_t size){
+	struct stat st;
+	int ret;
+	if(fstat(handle->spool_fd, &st) == 0) // content kept after an upload released the reservation
+		size = MAX(size, st.st_size);
+	for(;;){
+		g_mutex_lock(handle->mut);
+		const off_t reserved = handle->spool_size;
+		g_mutex_unlock(handle->mut);
+		if(size <= reserved)
+			return 0;
+		if( (ret = gfalfs_spool_reserve(size - reserved)) < 0)
+			return ret;
+		g_mutex_lock(handle->mut);
+		const gboolean unchanged = (handle->spool_size == reserved);
+		if(unchanged)
+			handle->spool_size = size;
+		g_mutex_unlock(handle->mut);
+		if(unchanged)
+			return 0;
+		gfalfs_spool_release(size - reserved); // changed by a concurrent call, try again
+	}
+}
+
+static void gfalfs_staging_register(gfalFS_file_handle handle){
+	g_static_mutex_lock(&staged_mutex);
+	if(staged_table == NULL){
+		staged_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		staged_cond = g_cond_new();
+	}
+	g_hash_table_replace(staged_table, g_strdup(handle->local_path), handle);
+	g_static_mutex_unlock(&staged_mutex);
+}
+
+// remove a handle from the table and wait for the control operations using it
+static void gfalfs_staging_unregister(gfalFS_file_handle handle){
+	g_static_mutex_lock(&staged_mutex);
+	if(staged_table != NULL && g_hash_table_lookup(staged_table, handle->local_path) == handle)
+		g_hash_table_remove(staged_table, handle->local_path);
+	while(handle->spool_users > 0)
+		g_cond_wait(staged_cond, g_static_mutex_get_mutex(&staged_mutex));
+	g_static_mutex_unlock(&staged_mutex);
+}
+
+// staged handle of a path, to release with gfalfs_staging_put, NULL if none
+static gfalFS_file_handle gfalfs_staging_get(const char* local_path){
+	g_static_mutex_lock(&staged_mutex);
+	gfalFS_file_handle handle = (staged_table)?g_hash_table_lookup(staged_table, local_path):NULL;
+	if(handle != NULL)
+		handle->spool_users++;
+	g_static_mutex_unlock(&staged_mutex);
+	return handle;
+}
+
+static void gfalfs_staging_put(gfalFS_file_handle handle){
+	g_static_mutex_lock(&staged_mutex);
+	handle->spool_users--;
+	g_cond_broadcast(staged_cond);
+	g_static_mutex_unlock(&staged_mutex);
+}
+
+// compare the checksum of the downloaded content with the storage one
+static int gfalfs_staging_verify(gfalFS_file_handle handle, gfalfs_checksum checksum){
+	char local_sum[GFALFS_CHECKSUM_MAX_LEN];
+	char remote_sum[GFALFS_CHECKSUM_MAX_LEN];
+	if(gfalfs_checksum_remote(handle->path, checksum->type, remote_sum, GFALFS_CHECKSUM_MAX_LEN) < 0)
+		return 0; // nothing to compare with
+	gfalfs_checksum_get_string(checksum, local_sum, GFALFS_CHECKSUM_MAX_LEN);
+	if(gfalfs_checksum_equal(local_sum, remote_sum) == FALSE){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_staging %s checksum mismatch, %s local %s remote %s", (char*) handle->path, gfalfs_checksum_type_name(checksum->type), local_sum, remote_sum);
+		return -(EIO);
+	}
+	return 0;
+}
+
+// copy the current remote content in the spool file
+static int gfalfs_staging_download(gfalFS_file_handle handle){
+	char err_buff[1024];
+	int ret = 0;
+	off_t offset = 0;
+	ssize_t r = 0;
+
+	const int fd = gfalfs_timed_open(handle->path, O_RDONLY, 0, err_buff, 1024);
+	if(fd < 0){
+		if(fd == -(ENOENT) && (handle->flags & O_CREAT)) // new file
+			return 0;
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_staging download err %d for path %s: %s ", -fd, (char*) handle->path, (char*) err_buff);
+		return fd;
+	}
+	gfalfs_checksum checksum = NULL;
+	if(gfalfs_get_checksum_type() != GFALFS_CHECKSUM_NONE)
+		checksum = gfalfs_checksum_new(gfalfs_get_checksum_type());
+	char* buffer = gfalfs_buffer_alloc(GFALFS_STAGING_BUFFER_SIZE);
+	if(buffer == NULL)
+		ret = -(ENOMEM);
+	while(buffer != NULL && (r = gfalfs_timed_pread(fd, buffer, GFALFS_STAGING_BUFFER_SIZE, offset, err_buff, 1024)) > 0){
+		if(checksum)
+			gfalfs_checksum_update(checksum, buffer, r);
+		if( (ret = gfalfs_staging_reserve(handle, offset + r)) < 0)
+			break;
+		if(pwrite(handle->spool_fd, buffer, r, offset) != r){
+			ret = -(errno);
+			break;
+		}
+		offset += r;
+	}
+	if(r < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_staging download err %d for path %s: %s ", (int) -r, (char*) handle->path, (char*) err_buff);
+		ret = r;
+	}
+	gfalfs_timed_close(fd, err_buff, 1024);
+	gfalfs_buffer_free(buffer);
+	if(checksum && ret == 0)
+		ret = gfalfs_staging_verify(handle, checksum);
+	gfalfs_checksum_delete(checksum);
+	return ret;
+}
+
+int gfalfs_staging_open(gfalFS_file_handle handle, gboolean load){
+	int ret = 0;
+	char* spool_path = g_build_filename(gfalfs_get_spool_dir(), "gfalfs_spool_XXXXXX", NULL);
+	handle->spool_fd = g_mkstemp(spool_path);
+	if(handle->spool_fd < 0){
+		ret = -(errno);
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_staging err %d : unable to create spool file %s", -ret, spool_path);
+		g_free(spool_path);
+		return ret;
+	}
+	// anonymous spool file, cleaned even in case of crash
+	unlink(spool_path);
+	g_free(spool_path);
+
+	if(load && (ret = gfalfs_staging_download(handle)) < 0){
+		gfalfs_staging_close(handle);
+		return ret;
+	}
+	// a newly created or truncated file has to be uploaded even if nothing is written
+	handle->dirty = !load;
+	gfalfs_staging_register(handle);
+	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_staging open %s, spool fd %d", (char*) handle->path, handle->spool_fd);
+	return 0;
+}
+
+int gfalfs_staging_read(gfalFS_file_handle handle, char* buf, size_t size, off_t offset){
+	ssize_t ret = pread(handle->spool_fd, buf, size, offset);
+	return (ret < 0)?(-(errno)):((int) ret);
+}
+
+int gfalfs_staging_write(gfalFS_file_handle handle, const char* buf, size_t size, off_t offset){
+	int ret;
+	if( (ret = gfalfs_staging_reserve(handle, offset + size)) < 0)
+		return ret;
+	ssize_t w = pwrite(handle->spool_fd, buf, size, offset);
+	if(w < 0)
+		return -(errno);
+	g_mutex_lock(handle->mut); // after an upload in progress, which clears the flag
+	handle->dirty = TRUE;
+	g_mutex_unlock(handle->mut);
+	return (int) w;
+}
+
+int gfalfs_staging_truncate(gfalFS_file_handle handle, off_t size){
+	int ret;
+	if( (ret = gfalfs_staging_reserve(handle, size)) < 0)
+		return ret;
+	if(ftruncate(handle->spool_fd, size) < 0)
+		return -(errno);
+	g_mutex_lock(handle->mut);
+	handle->dirty = TRUE;
+	g_mutex_unlock(handle->mut);
+	return 0;
+}
+
+int gfalfs_staging_fstat(gfalFS_file_handle handle, struct stat* st){
+	struct stat local_st;
+	if(fstat(handle->spool_fd, &local_st) < 0)
+		return -(errno);
+	memset(st, 0, sizeof(struct stat));
+	st->st_mode = S_IFREG | ((handle->mode)?(handle->mode & 07777):0644);
+	st->st_nlink = 1;
+	st->st_uid = getuid();
+	st->st_gid = getgid();
+	st->st_size = local_st.st_size;
+	st->st_atime = local_st.st_atime;
+	st->st_mtime = local_st.st_mtime;
+	st->st_ctime = local_st.st_ctime;
+	gfalfs_tune_stat(handle->path, st);
+	return 0;
+}
+
+// temporary url of an upload, hidden in the directory of the target
+static char* gfalfs_staging_part_url(const char* url){
+	const char* name = strrchr(url, '/');
+	name = (name)?name+1:url;
+	return g_strdup_printf("%.*s.%s.gfalfs_part_%08x", (int) (name - url), url, name, g_random_int());
+}
+
+// upload to the target, or with staging_atomic to a temporary name renamed over the target
+// once uploaded, the spool content stays readable but its reservation is released
+int gfalfs_staging_upload(gfalFS_file_handle handle){
+	char err_buff[1024];
+	char close_err[1024];
+	int ret = 0;
+	off_t offset = 0;
+	ssize_t r = 0;
+
+	g_mutex_lock(handle->mut);
+	if(!handle->dirty){
+		g_mutex_unlock(handle->mut);
+		return 0;
+	}
+	char* part_url = (gfalfs_get_staging_atomic())?gfalfs_staging_part_url(handle->path):NULL;
+	const char* url = (part_url)?part_url:handle->path;
+	gfalfs_log(NULL, G_LOG_LEVEL_MESSAGE, "gfalfs_staging upload %s through %s", (char*) handle->path, url);
+	const int fd = gfalfs_timed_open(url, O_WRONLY | O_CREAT | O_TRUNC, (handle->mode)?(handle->mode & 07777):0644, err_buff, 1024);
+	if(fd < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_staging upload err %d for path %s: %s ", -fd, url, (char*) err_buff);
+		g_mutex_unlock(handle->mut);
+		g_free(part_url);
+		return fd;
+	}
+	char* buffer = gfalfs_buffer_alloc(GFALFS_STAGING_BUFFER_SIZE);
+	if(buffer == NULL)
+		ret = -(ENOMEM);
+	const gint64 start = g_get_monotonic_time();
+	while(ret == 0 && (r = pread(handle->spool_fd, buffer, GFALFS_STAGING_BUFFER_SIZE, offset)) > 0){
+		ssize_t written = 0;
+		while(written < r){ // sequential offsets, supported by the protocols without random writes
+			const ssize_t w = gfalfs_timed_pwrite(fd, buffer + written, r - written, offset + written, err_buff, 1024);
+			if(w <= 0){
+				ret = (w < 0)?w:(-(EIO));
+				break;
+			}
+			written += w;
+		}
+		offset += written;
+	}
+	if(r < 0){
+		ret = -(errno);
+		g_strlcpy(err_buff, strerror(errno), 1024);
+	}
+	// the close commits the content on some protocols
+	const int c = gfalfs_timed_close(fd, (ret == 0)?err_buff:close_err, 1024);
+	if(c < 0 && ret == 0)
+		ret = c;
+	if(ret == 0 && part_url != NULL)
+		ret = gfalfs_timed_rename(part_url, handle->path, err_buff, 1024);
+	if(ret < 0){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_staging upload err %d for path %s: %s ", -ret, (char*) handle->path, (char*) err_buff);
+		if(part_url != NULL && gfalfs_timed_unlink(part_url, err_buff, 1024) < 0)
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING , "gfalfs_staging unable to remove %s: %s ", part_url, (char*) err_buff);
+	}else{
+		gfalfs_report_transfer(handle->path, offset, g_get_monotonic_time() - start);
+		handle->dirty = FALSE;
+		// the content is stored remotely, the next write reserves it again
+		gfalfs_spool_release(handle->spool_size);
+		handle->spool_size = 0;
+	}
+	gfalfs_buffer_free(buffer);
+	g_free(part_url);
+	gfalfs_cache_invalidate(handle->local_path);
+	g_mutex_unlock(handle->mut);
+	return ret;
+}
+
+void gfalfs_staging_close(gfalFS_file_handle handle){
+	if(handle->spool_fd < 0)
+		return;
+	gfalfs_staging_unregister(handle);
+	close(handle->spool_fd);
+	handle->spool_fd = -1;
+	gfalfs_spool_release(handle->spool_size);
+	handle->spool_size = 0;
+}
+
+int gfalfs_staging_getattr(const char* local_path, struct stat* st){
+	gfalFS_file_handle handle = gfalfs_staging_get(local_path);
+	if(handle == NULL)
+		return -(ENOENT);
+	const int ret = gfalfs_staging_fstat(handle, st);
+	gfalfs_staging_put(handle);
+	return ret;
+}
+
+int gfalfs_staging_upload_path(const char* local_path){
+	gfalFS_file_handle handle = gfalfs_staging_get(local_path);
+	if(handle == NULL)
+		return -(ENOENT);
+	const int ret = gfalfs_staging_upload(handle);
+	gfalfs_staging_put(handle);
+	return ret;
+}
+
+int gfalfs_staging_truncate_path(const char* local_path, off_t size){
+	gfalFS_file_handle handle = gfalfs_staging_get(local_path);
+	if(handle == NULL)
+		return -(ENOENT);
+	const int ret = gfalfs_staging_truncate(handle, size);
+	gfalfs_staging_put(handle);
+	return ret;
+}
@@ -0,0 +1,56 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_staging.h
+ * @brief local write staging, files opened for writing are backed by a local
+ * spool file and uploaded in one sequential transfer when closed
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "gfal_ext.h"
+
+// TRUE if a file opened with these flags has to be staged
+gboolean gfalfs_staging_wanted(int flags);
+
+// create the spool file of a handle, download the current remote content if load is TRUE
+int gfalfs_staging_open(gfalFS_file_handle handle, gboolean load);
+
+int gfalfs_staging_read(gfalFS_file_handle handle, char* buf, size_t size, off_t offset);
+
+int gfalfs_staging_write(gfalFS_file_handle handle, const char* buf, size_t size, off_t offset);
+
+int gfalfs_staging_truncate(gfalFS_file_handle handle, off_t size);
+
+int gfalfs_staging_fstat(gfalFS_file_handle handle, struct stat* st);
+
+// upload the spool content if it changed since the last upload
+int gfalfs_staging_upload(gfalFS_file_handle handle);
+
+// delete the spool file and release its space
+void gfalfs_staging_close(gfalFS_file_handle handle);
+
+// attributes of a path currently staged, return -(ENOENT) if the path is not staged
+int gfalfs_staging_getattr(const char* local_path, struct stat* st);
+
+// upload a path currently staged, return -(ENOENT) if the path is not staged
+int gfalfs_staging_upload_path(const char* local_path);
+
+// truncate a path currently staged, return -(ENOENT) if the path is not staged
+int gfalfs_staging_truncate_path(const char* local_path, off_t size);
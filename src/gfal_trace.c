@@ -0,0 +1,416 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+
+/*
+ * gfal_trace.c
+ * recording of the fuse operations in a memory-mapped ring file
+ *
+ * a record costs an atomic increment and a store in the mapping. The paths
+ * recorded recently are remembered in a fixed table indexed by their id, the
+ * other ones are queued to a writer thread appending them to the path table.
+ * A path forgotten by the table is written again, the readers keep one entry
+ * per id
+ * */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gfal_trace.h"
+#include "gfal_ext.h"
+
+// smallest ring, in records
+#define GFALFS_TRACE_MIN_RECORDS 1024
+// slots of the table of the recent paths, a power of two
+#define GFALFS_TRACE_PATHS_SEEN (1 << 16)
+// paths waiting for the writer, the new ones are not recorded beyond
+#define GFALFS_TRACE_PATHS_QUEUED (1 << 16)
+
+typedef struct _gfalfs_trace_path{
+	guint64 id;
+	char path[];
+} gfalfs_trace_path;
+
+static gfalfs_trace_header* trace_header = NULL;
+static gfalfs_trace_record* trace_records = NULL;
+static size_t trace_map_size = 0;
+static gint64 trace_origin = 0; // monotonic time of start_time
+
+static volatile gpointer paths_seen[GFALFS_TRACE_PATHS_SEEN]; // id of the last path written in each slot
+static GAsyncQueue* paths_queue = NULL;
+static GThread* paths_writer = NULL;
+static gfalfs_trace_path paths_end; // stops the writer
+static volatile gint paths_dropped = 0; // paths not queued while the writer was late
+static FILE* paths_file = NULL;
+
+static struct fuse_operations trace_ops;
+static struct fuse_operations real_ops;
+
+
+gboolean gfalfs_trace_open(const char* trace_file, guint64 trace_size){
+	guint32 capacity = GFALFS_TRACE_MIN_RECORDS;
+	while( ((guint64) capacity) * 2 * sizeof(gfalfs_trace_record) <= trace_size && capacity < (1U << 30))
+		capacity *= 2;
+	const size_t map_size = GFALFS_TRACE_HEADER_SIZE + ((size_t) capacity) * sizeof(gfalfs_trace_record);
+
+	int fd = open(trace_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0 || ftruncate(fd, map_size) != 0){
+		g_printerr("Unable to create the trace file %s : %s \n", trace_file, strerror(errno));
+		if(fd >= 0)
+			close(fd);
+		return FALSE;
+	}
+	void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED){
+		g_printerr("Unable to map the trace file %s : %s \n", trace_file, strerror(errno));
+		return FALSE;
+	}
+	gchar* paths_name = g_strconcat(trace_file, GFALFS_TRACE_PATHS_SUFFIX, NULL);
+	paths_file = fopen(paths_name, "w");
+	if(paths_file == NULL){
+		g_printerr("Unable to create the trace path table %s : %s \n", paths_name, strerror(errno));
+		g_free(paths_name);
+		munmap(map, map_size);
+		return FALSE;
+	}
+	g_free(paths_name);
+
+	GTimeVal now;
+	g_get_current_time(&now);
+	trace_origin = g_get_monotonic_time();
+	trace_map_size = map_size;
+	trace_header = (gfalfs_trace_header*) map;
+	memcpy(trace_header->magic, GFALFS_TRACE_MAGIC, 8);
+	trace_header->version = GFALFS_TRACE_VERSION;
+	trace_header->record_size = sizeof(gfalfs_trace_record);
+	trace_header->capacity = capacity;
+	trace_header->next = 0;
+	trace_header->start_time = ((guint64) now.tv_sec) * G_USEC_PER_SEC + now.tv_usec;
+	trace_records = (gfalfs_trace_record*) (((char*) map) + GFALFS_TRACE_HEADER_SIZE);
+	paths_queue = g_async_queue_new();
+	return TRUE;
+}
+
+// append the queued paths to the path table, flushed when the queue is empty
+static gpointer gfalfs_trace_paths_write(gpointer data){
+	gfalfs_trace_path* item;
+	while( (item = g_async_queue_pop(paths_queue)) != &paths_end){
+		gchar* escaped = g_strescape(item->path, NULL);
+		fprintf(paths_file, "%016llx %s\n", (unsigned long long) item->id, escaped);
+		g_free(escaped);
+		g_free(item);
+		if(g_async_queue_length(paths_queue) <= 0)
+			fflush(paths_file);
+	}
+	fflush(paths_file);
+	return NULL;
+}
+
+// id of a path, queued for the path table unless it was written recently
+static guint64 gfalfs_trace_path_id(const char* path){
+	const guint64 id = (guint64) gfalfs_path_ino(path);
+	volatile gpointer* slot = paths_seen + (id & (GFALFS_TRACE_PATHS_SEEN - 1));
+	if(g_atomic_pointer_get(slot) == GSIZE_TO_POINTER((gsize) id) || paths_writer == NULL)
+		return id;
+	if(g_async_queue_length(paths_queue) >= GFALFS_TRACE_PATHS_QUEUED){ // the writer is late, retried at the next use of the path
+		if(g_atomic_int_exchange_and_add(&paths_dropped, 1) == 0)
+			gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_trace path table writer late, paths not recorded");
+		return id;
+	}
+	const size_t len = strlen(path);
+	gfalfs_trace_path* item = g_malloc(sizeof(gfalfs_trace_path) + len + 1);
+	item->id = id;
+	memcpy(item->path, path, len + 1);
+	g_atomic_pointer_set(slot, GSIZE_TO_POINTER((gsize) id));
+	g_async_queue_push(paths_queue, item);
+	return id;
+}
+
+static void gfalfs_trace_record_op(gfalfs_trace_op op, const char* path, guint64 handle, guint64 offset, guint64 size,
+										guint64 arg, gint64 start, int result){
+	const gint64 end = g_get_monotonic_time();
+	const guint32 seq = (guint32) g_atomic_int_exchange_and_add(&(trace_header->next), 1);
+	gfalfs_trace_record* r = trace_records + (seq & (trace_header->capacity - 1));
+	r->seq = 0; // the slot is rewritten
+	r->op = op;
+	r->reserved = 0;
+	r->result = result;
+	r->latency = (guint32) MIN(end - start, G_MAXUINT32);
+	r->start = start - trace_origin;
+	r->path_id = (path)?gfalfs_trace_path_id(path):0;
+	r->handle = handle;
+	r->offset = offset;
+	r->size = size;
+	r->arg = arg;
+	g_atomic_int_set((gint*) &(r->seq), (gint) (seq + 1)); // publish the record
+}
+
+static int trace_getattr(const char* path, struct stat* st){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.getattr(path, st);
+	gfalfs_trace_record_op(GFALFS_TRACE_GETATTR, path, 0, 0, 0, 0, start, ret);
+	return ret;
+}
+
+static int trace_fgetattr(const char* path, struct stat* st, struct fuse_file_info* fi){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.fgetattr(path, st, fi);
+	gfalfs_trace_record_op(GFALFS_TRACE_FGETATTR, path, fi->fh, 0, 0, 0, start, ret);
+	return ret;
+}
+
+static int trace_readlink(const char* path, char* buff, size_t s_buff){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.readlink(path, buff, s_buff);
+	gfalfs_trace_record_op(GFALFS_TRACE_READLINK, path, 0, 0, s_buff, 0, start, ret);
+	return ret;
+}
+
+static int trace_opendir(const char* path, struct fuse_file_info* fi){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.opendir(path, fi);
+	gfalfs_trace_record_op(GFALFS_TRACE_OPENDIR, path, (ret == 0)?fi->fh:0, 0, 0, 0, start, ret);
+	return ret;
+}
+
+static int trace_readdir(const char* path, void* buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info* fi){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.readdir(path, buf, filler, offset, fi);
+	gfalfs_trace_record_op(GFALFS_TRACE_READDIR, path, fi->fh, offset, 0, 0, start, ret);
+	return ret;
+}
+
+static int trace_releasedir(const char* path, struct fuse_file_info* fi){
+	const guint64 handle = fi->fh;
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.releasedir(path, fi);
+	gfalfs_trace_record_op(GFALFS_TRACE_RELEASEDIR, path, handle, 0, 0, 0, start, ret);
+	return ret;
+}
+
+static int trace_open(const char* path, struct fuse_file_info* fi){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.open(path, fi);
+	gfalfs_trace_record_op(GFALFS_TRACE_OPEN, path, (ret == 0)?fi->fh:0, 0, 0, fi->flags, start, ret);
+	return ret;
+}
+
+static int trace_create(const char* path, mode_t mode, struct fuse_file_info* fi){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.create(path, mode, fi);
+	gfalfs_trace_record_op(GFALFS_TRACE_CREATE, path, (ret == 0)?fi->fh:0, 0, mode, fi->flags, start, ret);
+	return ret;
+}
+
+static int trace_read(const char* path, char* buf, size_t size, off_t offset, struct fuse_file_info* fi){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.read(path, buf, size, offset, fi);
+	gfalfs_trace_record_op(GFALFS_TRACE_READ, path, fi->fh, offset, size, 0, start, ret);
+	return ret;
+}
+
+static int trace_write(const char* path, const char* buf, size_t size, off_t offset, struct fuse_file_info* fi){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.write(path, buf, size, offset, fi);
+	gfalfs_trace_record_op(GFALFS_TRACE_WRITE, path, fi->fh, offset, size, 0, start, ret);
+	return ret;
+}
+
+static int trace_flush(const char* path, struct fuse_file_info* fi){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.flush(path, fi);
+	gfalfs_trace_record_op(GFALFS_TRACE_FLUSH, path, fi->fh, 0, 0, 0, start, ret);
+	return ret;
+}
+
+static int trace_release(const char* path, struct fuse_file_info* fi){
+	const guint64 handle = fi->fh;
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.release(path, fi);
+	gfalfs_trace_record_op(GFALFS_TRACE_RELEASE, path, handle, 0, 0, 0, start, ret);
+	return ret;
+}
+
+static int trace_access(const char* path, int mode){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.access(path, mode);
+	gfalfs_trace_record_op(GFALFS_TRACE_ACCESS, path, 0, 0, 0, mode, start, ret);
+	return ret;
+}
+
+static int trace_mkdir(const char* path, mode_t mode){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.mkdir(path, mode);
+	gfalfs_trace_record_op(GFALFS_TRACE_MKDIR, path, 0, 0, 0, mode, start, ret);
+	return ret;
+}
+
+static int trace_rmdir(const char* path){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.rmdir(path);
+	gfalfs_trace_record_op(GFALFS_TRACE_RMDIR, path, 0, 0, 0, 0, start, ret);
+	return ret;
+}
+
+static int trace_unlink(const char* path){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.unlink(path);
+	gfalfs_trace_record_op(GFALFS_TRACE_UNLINK, path, 0, 0, 0, 0, start, ret);
+	return ret;
+}
+
+static int trace_rename(const char* oldpath, const char* newpath){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.rename(oldpath, newpath);
+	gfalfs_trace_record_op(GFALFS_TRACE_RENAME, oldpath, 0, 0, 0, gfalfs_trace_path_id(newpath), start, ret);
+	return ret;
+}
+
+static int trace_truncate(const char* path, off_t size){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.truncate(path, size);
+	gfalfs_trace_record_op(GFALFS_TRACE_TRUNCATE, path, 0, 0, size, 0, start, ret);
+	return ret;
+}
+
+static int trace_ftruncate(const char* path, off_t size, struct fuse_file_info* fi){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.ftruncate(path, size, fi);
+	gfalfs_trace_record_op(GFALFS_TRACE_FTRUNCATE, path, fi->fh, 0, size, 0, start, ret);
+	return ret;
+}
+
+static int trace_getxattr(const char* path, const char* name, char* buff, size_t s_buff){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.getxattr(path, name, buff, s_buff);
+	gfalfs_trace_record_op(GFALFS_TRACE_GETXATTR, path, 0, 0, s_buff, 0, start, ret);
+	return ret;
+}
+
+static int trace_setxattr(const char* path, const char* name, const char* value, size_t size, int flags){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.setxattr(path, name, value, size, flags);
+	gfalfs_trace_record_op(GFALFS_TRACE_SETXATTR, path, 0, 0, size, flags, start, ret);
+	return ret;
+}
+
+static int trace_symlink(const char* target, const char* path){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.symlink(target, path);
+	gfalfs_trace_record_op(GFALFS_TRACE_SYMLINK, path, 0, 0, 0, gfalfs_trace_path_id(target), start, ret);
+	return ret;
+}
+
+static int trace_chmod(const char* path, mode_t mode){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.chmod(path, mode);
+	gfalfs_trace_record_op(GFALFS_TRACE_CHMOD, path, 0, 0, 0, mode, start, ret);
+	return ret;
+}
+
+static int trace_chown(const char* path, uid_t uid, gid_t gid){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.chown(path, uid, gid);
+	gfalfs_trace_record_op(GFALFS_TRACE_CHOWN, path, 0, 0, 0, (((guint64) uid) << 32) | (guint32) gid, start, ret);
+	return ret;
+}
+
+static guint64 trace_time(const struct timespec* ts){
+	if(ts->tv_nsec == UTIME_NOW)
+		return GFALFS_TRACE_TIME_NOW;
+	if(ts->tv_nsec == UTIME_OMIT)
+		return GFALFS_TRACE_TIME_OMIT;
+	return ((guint64) ts->tv_sec) * G_USEC_PER_SEC + ts->tv_nsec / 1000;
+}
+
+static int trace_utimens(const char* path, const struct timespec tv[2]){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.utimens(path, tv);
+	gfalfs_trace_record_op(GFALFS_TRACE_UTIMENS, path, 0, trace_time(&tv[0]), trace_time(&tv[1]), 0, start, ret);
+	return ret;
+}
+
+static int trace_listxattr(const char* path, char* list, size_t s_list){
+	const gint64 start = g_get_monotonic_time();
+	const int ret = real_ops.listxattr(path, list, s_list);
+	gfalfs_trace_record_op(GFALFS_TRACE_LISTXATTR, path, 0, 0, s_list, 0, start, ret);
+	return ret;
+}
+
+// the writer thread starts after fuse went in background
+static void* trace_init(struct fuse_conn_info* conn){
+	GError* tmp_err = NULL;
+	if( (paths_writer = g_thread_create(gfalfs_trace_paths_write, NULL, TRUE, &tmp_err)) == NULL){
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_trace unable to start the path table writer : %s, paths are not recorded", tmp_err->message);
+		g_error_free(tmp_err);
+	}
+	return (real_ops.init)?real_ops.init(conn):NULL;
+}
+
+static void trace_destroy(void* private_data){
+	if(real_ops.destroy)
+		real_ops.destroy(private_data);
+	msync(trace_header, trace_map_size, MS_SYNC);
+	if(paths_writer != NULL){
+		g_async_queue_push(paths_queue, &paths_end);
+		g_thread_join(paths_writer);
+		paths_writer = NULL;
+	}
+	if(g_atomic_int_get(&paths_dropped) > 0)
+		gfalfs_log(NULL, G_LOG_LEVEL_WARNING, "gfalfs_trace %d paths not queued for the path table, their records may not be replayed",
+					(int) g_atomic_int_get(&paths_dropped));
+}
+
+struct fuse_operations* gfalfs_trace_operations(const struct fuse_operations* ops){
+	real_ops = *ops;
+	trace_ops = *ops;
+	trace_ops.init = trace_init;
+	trace_ops.destroy = trace_destroy;
+#define GFALFS_TRACE_WRAP(name) if(ops->name) trace_ops.name = trace_##name
+	GFALFS_TRACE_WRAP(getattr);
+	GFALFS_TRACE_WRAP(fgetattr);
+	GFALFS_TRACE_WRAP(readlink);
+	GFALFS_TRACE_WRAP(opendir);
+	GFALFS_TRACE_WRAP(readdir);
+	GFALFS_TRACE_WRAP(releasedir);
+	GFALFS_TRACE_WRAP(open);
+	GFALFS_TRACE_WRAP(create);
+	GFALFS_TRACE_WRAP(read);
+	GFALFS_TRACE_WRAP(write);
+	GFALFS_TRACE_WRAP(flush);
+	GFALFS_TRACE_WRAP(release);
+	GFALFS_TRACE_WRAP(access);
+	GFALFS_TRACE_WRAP(mkdir);
+	GFALFS_TRACE_WRAP(rmdir);
+	GFALFS_TRACE_WRAP(unlink);
+	GFALFS_TRACE_WRAP(rename);
+	GFALFS_TRACE_WRAP(truncate);
+	GFALFS_TRACE_WRAP(ftruncate);
+	GFALFS_TRACE_WRAP(getxattr);
+	GFALFS_TRACE_WRAP(setxattr);
+	GFALFS_TRACE_WRAP(symlink);
+	GFALFS_TRACE_WRAP(chmod);
+	GFALFS_TRACE_WRAP(chown);
+	GFALFS_TRACE_WRAP(utimens);
+	GFALFS_TRACE_WRAP(listxattr);
+#undef GFALFS_TRACE_WRAP
+	return &trace_ops;
+}
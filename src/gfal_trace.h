@@ -0,0 +1,30 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_trace.h
+ * @brief binary trace of the fuse operations, for the analysis and the replay
+ * of production workloads with gfalfs_replay
+ */
+
+#include "gfal_opers.h"
+#include "gfal_trace_format.h"
+
+// create the ring file and its path table, return FALSE with a message on failure
+gboolean gfalfs_trace_open(const char* trace_file, guint64 trace_size);
+
+// operations recording each call of ops in the trace
+struct fuse_operations* gfalfs_trace_operations(const struct fuse_operations* ops);
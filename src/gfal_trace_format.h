@@ -0,0 +1,98 @@
+#pragma once
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); 
+// you may not use this file except in compliance with the License. 
+// You may obtain a copy of the License at 
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0 
+// 
+// Unless required by applicable law or agreed to in writing, software 
+// distributed under the License is distributed on an "AS IS" BASIS, 
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+// See the License for the specific language governing permissions and 
+// limitations under the License.
+
+/*
+ * @file gfal_trace_format.h
+ * @brief layout of the trace files, shared by gfalFS and gfalfs_replay
+ *
+ * a trace is a ring file : a header page followed by a power of two number of
+ * fixed size records, the record of the sequence number seq is in the slot
+ * seq % capacity. The paths are in a side file <trace>.paths, one line
+ * "<path id in hexadecimal> <escaped path>" for each new path, a path can be
+ * written more than once
+ */
+
+#include <glib.h>
+
+#define GFALFS_TRACE_MAGIC "GFALFSTR"
+#define GFALFS_TRACE_VERSION 1
+#define GFALFS_TRACE_HEADER_SIZE 4096
+#define GFALFS_TRACE_PATHS_SUFFIX ".paths"
+
+typedef enum{
+	GFALFS_TRACE_GETATTR=0,
+	GFALFS_TRACE_FGETATTR,
+	GFALFS_TRACE_READLINK,
+	GFALFS_TRACE_OPENDIR,
+	GFALFS_TRACE_READDIR,
+	GFALFS_TRACE_RELEASEDIR,
+	GFALFS_TRACE_OPEN,
+	GFALFS_TRACE_CREATE,
+	GFALFS_TRACE_READ,
+	GFALFS_TRACE_WRITE,
+	GFALFS_TRACE_FLUSH,
+	GFALFS_TRACE_RELEASE,
+	GFALFS_TRACE_ACCESS,
+	GFALFS_TRACE_MKDIR,
+	GFALFS_TRACE_RMDIR,
+	GFALFS_TRACE_UNLINK,
+	GFALFS_TRACE_RENAME,
+	GFALFS_TRACE_TRUNCATE,
+	GFALFS_TRACE_FTRUNCATE,
+	GFALFS_TRACE_GETXATTR,
+	GFALFS_TRACE_SETXATTR,
+	GFALFS_TRACE_SYMLINK,
+	GFALFS_TRACE_CHMOD,
+	GFALFS_TRACE_CHOWN,
+	GFALFS_TRACE_UTIMENS,
+	GFALFS_TRACE_LISTXATTR,
+	GFALFS_TRACE_OPS
+} gfalfs_trace_op;
+
+typedef struct _gfalfs_trace_header{
+	char magic[8];
+	guint32 version;
+	guint32 record_size;
+	guint32 capacity; // records, a power of two
+	volatile gint next; // sequence number of the next record
+	guint64 start_time; // epoch of the trace in micro-seconds
+} gfalfs_trace_header;
+
+typedef struct _gfalfs_trace_record{
+	volatile guint32 seq; // sequence number + 1, written last, 0 for an empty slot
+	guint16 op; // gfalfs_trace_op
+	guint16 reserved;
+	gint32 result; // return value of the operation, -errno on error
+	guint32 latency; // micro-seconds
+	guint64 start; // micro-seconds since start_time
+	guint64 path_id;
+	guint64 handle; // file or directory handle, 0 for the path operations
+	guint64 offset; // access time of utimens
+	guint64 size; // modification time of utimens
+	guint64 arg; // open flags, mode, uid << 32 | gid, path id of the new path of a rename or of a symlink target
+} gfalfs_trace_record;
+
+// utimens times are in micro-seconds since the epoch, or one of these
+#define GFALFS_TRACE_TIME_NOW G_MAXUINT64
+#define GFALFS_TRACE_TIME_OMIT (G_MAXUINT64 - 1)
+
+static inline const char* gfalfs_trace_op_name(guint16 op){
+	static const char* names[] = { "getattr", "fgetattr", "readlink", "opendir", "readdir", "releasedir",
+							"open", "create", "read", "write", "flush", "release", "access",
+							"mkdir", "rmdir", "unlink", "rename", "truncate", "ftruncate",
+							"getxattr", "setxattr", "symlink", "chmod", "chown", "utimens", "listxattr" };
+	return (op < GFALFS_TRACE_OPS)?names[op]:"unknown";
+}
@@ -24,6 +24,8 @@
 #include <syslog.h>
 #include <glib.h>
 #include "gfal_opers.h"
+#include "gfal_mounts.h"
+#include "gfal_trace.h"
 #include "params.h"
 
 static const char* str_version = _GFALFS_VERSION;
@@ -48,9 +50,10 @@ static void path_to_abspath(const char* path, char* abs_buff, size_t s_buff){
 static void print_help(char* progname){
 	g_printerr("Usage %s [-d] [-s] [-v] [mount_point] [remote_url]\n", progname);
 	g_printerr("      %s [-g]           [mount_point]             \n", progname);
+	g_printerr("      %s -o mounts=[mount_table] [mount_point]   \n", progname);
 	g_printerr("\t [-d] : Debug mode 					          \n");	
 	g_printerr("\t [-s] : Single thread mode			          \n");	
-    g_printerr("\t [-o] : pass fuse specific option  			  \n");
+    g_printerr("\t [-o] : gfalFS or fuse specific option, see man gfalFS \n");
 	g_printerr("\t [-g] : Guid mode, without grid url		      \n");
 	g_printerr("\t [-v] : Verbose mode, log all events with syslog, can cause major slowdown \n");
 	g_printerr("\t [-V] : Print version number \n");
@@ -60,9 +63,31 @@ static void print_version(){
 	printf("gfalFS_version : %s \n", str_version);
 }
 
+// split a -o option list, keep the gfalFS options and forward the others to fuse
+static void parse_mount_options(const char* opts, GString* fuse_opts){
+	gchar** list = g_strsplit(opts, ",", -1);
+	gchar** p;
+	for(p = list; *p != NULL; ++p){
+		if(**p == '\0')
+			continue;
+		gchar* value = strchr(*p, '=');
+		if(value != NULL)
+			*value++ = '\0';
+		if(gfalfs_parse_option(*p, value))
+			continue;
+		if(value != NULL)
+			*(value-1) = '=';
+		if(fuse_opts->len > 0)
+			g_string_append_c(fuse_opts, ',');
+		g_string_append(fuse_opts, *p);
+	}
+	g_strfreev(list);
+}
+
 static void parse_args(int argc, char** argv, int* targc, char** targv){
 	int c;
-	char abs_path[2048];
+	static char abs_path[2048];
+	GString* fuse_opts = g_string_new("");
     while( (c = getopt(argc, argv, "dshgvVo:"))  != -1){
 		switch(c){
 			case 'd':
@@ -88,7 +113,7 @@ static void parse_args(int argc, char** argv, int* targc, char** targv){
 				print_version();
 				exit(1);
             case 'o':
-                // fuse options
+                parse_mount_options(optarg, fuse_opts);
                 break;
 			case '?':
 				g_printerr("Unknow option -%c \n", optopt);
@@ -96,12 +121,34 @@ static void parse_args(int argc, char** argv, int* targc, char** targv){
 				exit(1);
 		}		
 	}
+	if(gfalfs_check_options() == FALSE)
+		exit(1);
 	int index = optind;
 #if FUSE_MINOR_VERSION >= 8
 	targv[(*targc)++] = "-obig_writes";
 #endif
 	//targv[(*targc)++] = "-odirect_io";
-	if(guid_mode){
+	if(gfalfs_get_page_cache_mode())
+		targv[(*targc)++] = "-ouse_ino";
+	if(fuse_opts->len > 0){
+		targv[(*targc)++] = "-o";
+		targv[(*targc)++] = g_string_free(fuse_opts, FALSE);
+	}else{
+		g_string_free(fuse_opts, TRUE);
+	}
+	if(gfalfs_get_mounts_file() != NULL){
+		if(index +1 != argc){
+			g_printerr("Bad number of arguments \n");
+			print_help(argv[0]);
+			exit(1);
+		}
+		if(gfalfs_mounts_load(gfalfs_get_mounts_file()) == FALSE)
+			exit(1);
+		gfalfs_set_remote_mount_point("");
+		path_to_abspath(argv[index++], abs_path, 2048);
+		gfalfs_set_local_mount_point(abs_path);
+		targv[(*targc)++] = abs_path;
+	}else if(guid_mode){
 		if(index +1 != argc){
 			g_printerr("Bad number of arguments \n");
 			print_help(argv[0]);
@@ -136,5 +183,10 @@ int main(int argc, char *argv[])
 	char* targv[20];
 	targv[0] = argv[0]; 
 	parse_args(argc, argv, &targc, targv);
+	if(gfalfs_get_trace_file() != NULL){
+		if(gfalfs_trace_open(gfalfs_get_trace_file(), gfalfs_get_trace_size()) == FALSE)
+			exit(1);
+		return fuse_main(targc, targv, gfalfs_trace_operations(&gfal_oper), NULL);
+	}
 	return fuse_main(targc, targv, &gfal_oper,NULL);
 }
@@ -18,12 +18,58 @@
 #include <errno.h>
 #include <glib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
 #include <syslog.h>
 
 #include "params.h"
+#include "gfal_checksum.h"
+#include "gfal_bulk.h"
 
 static gboolean verbose_mode = FALSE;
 static gboolean debug_mode = FALSE;
+static gboolean page_cache_mode = FALSE;
+static guint64 blksize = 0;
+static guint64 blksize_min = (1 << 12);
+static guint64 blksize_max = (1 << 24);
+static guint64 md_cache_ttl = 0;
+static gboolean md_cache_ttl_set = FALSE;
+static guint64 link_cache_ttl = 0;
+static gboolean link_cache_ttl_set = FALSE;
+static guint64 md_cache_size = (1 << 20);
+static gboolean crawl_mode = FALSE;
+static guint64 crawl_threads = 8;
+static gboolean staging_mode = FALSE;
+static gboolean staging_atomic = FALSE;
+static char* spool_dir = NULL;
+static char* mounts_file = NULL;
+static char* trace_file = NULL;
+static guint64 trace_size = 64*1024*1024;
+static guint64 spool_max = G_GUINT64_CONSTANT(1) << 32;
+static guint64 spool_wait = 60;
+static gfalfs_checksum_type checksum_type = GFALFS_CHECKSUM_NONE;
+static gfalfs_checksum_type checksum_untyped = GFALFS_CHECKSUM_NONE;
+static gboolean readahead_mode = FALSE;
+static guint64 readahead_blocks = 4;
+static guint64 block_size = (1 << 20);
+static guint64 cache_size = (1 << 28);
+static guint64 buffer_mem = (1 << 29);
+static guint64 retries = 3;
+static guint64 retry_delay = 500;
+static gboolean offline_mode = FALSE;
+static guint64 offline_errors = 5;
+static guint64 offline_timeout = 30;
+static guint64 offline_probe = 10;
+static guint64 md_timeout = 0;
+static guint64 ns_timeout = 0;
+static guint64 io_timeout = 0;
+static guint64 op_threads = 64;
+static gfalfs_ns_safety ns_safety = GFALFS_NS_SYNC;
+static guint64 bulk_size = 256;
+static guint64 bulk_threads = 8;
+
+// default ttl of the metadata cache when the crawler is enabled
+#define GFALFS_CRAWL_MD_CACHE_TTL 300
 
 /**
  * define verbose mode for gfalFS and GFAL 2.0
@@ -51,6 +97,379 @@ inline gboolean gfalfs_get_debug_mode(){
 }
 
 
+/**
+ * define page cache mode : stable inodes and kernel cache kept between opens
+ * */
+void gfalfs_set_page_cache_mode(gboolean status){
+	page_cache_mode= status;
+}
+
+inline gboolean gfalfs_get_page_cache_mode(){
+	return page_cache_mode;
+}
+
+
+inline guint64 gfalfs_get_blksize(){
+	return blksize;
+}
+
+inline guint64 gfalfs_get_blksize_min(){
+	return blksize_min;
+}
+
+inline guint64 gfalfs_get_blksize_max(){
+	return blksize_max;
+}
+
+
+inline guint64 gfalfs_get_md_cache_ttl(){
+	return md_cache_ttl;
+}
+
+inline guint64 gfalfs_get_link_cache_ttl(){
+	return (link_cache_ttl_set)?link_cache_ttl:md_cache_ttl;
+}
+
+inline guint64 gfalfs_get_md_cache_size(){
+	return md_cache_size;
+}
+
+inline gboolean gfalfs_get_crawl_mode(){
+	return crawl_mode;
+}
+
+inline guint64 gfalfs_get_crawl_threads(){
+	return crawl_threads;
+}
+
+inline gboolean gfalfs_get_staging_mode(){
+	return staging_mode;
+}
+
+inline gboolean gfalfs_get_staging_atomic(){
+	return staging_atomic;
+}
+
+const char* gfalfs_get_spool_dir(){
+	return (spool_dir)?spool_dir:g_get_tmp_dir();
+}
+
+const char* gfalfs_get_mounts_file(){
+	return mounts_file;
+}
+
+const char* gfalfs_get_trace_file(){
+	return trace_file;
+}
+
+inline guint64 gfalfs_get_trace_size(){
+	return trace_size;
+}
+
+inline guint64 gfalfs_get_spool_max(){
+	return spool_max;
+}
+
+inline guint64 gfalfs_get_spool_wait(){
+	return spool_wait;
+}
+
+inline gboolean gfalfs_get_readahead_mode(){
+	return readahead_mode;
+}
+
+inline guint64 gfalfs_get_readahead_blocks(){
+	return readahead_blocks;
+}
+
+inline guint64 gfalfs_get_block_size(){
+	return block_size;
+}
+
+inline guint64 gfalfs_get_cache_size(){
+	return cache_size;
+}
+
+inline guint64 gfalfs_get_buffer_mem(){
+	return buffer_mem;
+}
+
+inline guint64 gfalfs_get_retries(){
+	return retries;
+}
+
+inline guint64 gfalfs_get_retry_delay(){
+	return retry_delay;
+}
+
+inline gboolean gfalfs_get_offline_mode(){
+	return offline_mode;
+}
+
+inline guint64 gfalfs_get_offline_errors(){
+	return offline_errors;
+}
+
+inline guint64 gfalfs_get_offline_timeout(){
+	return offline_timeout;
+}
+
+inline guint64 gfalfs_get_offline_probe(){
+	return offline_probe;
+}
+
+inline guint64 gfalfs_get_md_timeout(){
+	return md_timeout;
+}
+
+inline guint64 gfalfs_get_ns_timeout(){
+	return ns_timeout;
+}
+
+inline guint64 gfalfs_get_io_timeout(){
+	return io_timeout;
+}
+
+inline guint64 gfalfs_get_op_threads(){
+	return op_threads;
+}
+
+inline int gfalfs_get_ns_safety(){
+	return ns_safety;
+}
+
+inline guint64 gfalfs_get_bulk_size(){
+	return bulk_size;
+}
+
+inline guint64 gfalfs_get_bulk_threads(){
+	return bulk_threads;
+}
+
+inline int gfalfs_get_checksum_type(){
+	return checksum_type;
+}
+
+inline int gfalfs_get_checksum_untyped(){
+	return checksum_untyped;
+}
+
+
+gboolean gfalfs_parse_size(const char* str, guint64* res){
+	char* end = NULL;
+	guint shift = 0;
+	if(str == NULL || g_ascii_isdigit(*str) == FALSE)
+		return FALSE;
+	errno = 0;
+	guint64 val = g_ascii_strtoull(str, &end, 10);
+	if(errno == ERANGE)
+		return FALSE;
+	switch(*end){
+		case 'g': case 'G':
+			shift += 10;
+			/* fall through */
+		case 'm': case 'M':
+			shift += 10;
+			/* fall through */
+		case 'k': case 'K':
+			shift += 10;
+			++end;
+			break;
+	}
+	if(*end != '\0' || val > (G_MAXUINT64 >> shift)) // overflow of the suffix
+		return FALSE;
+	*res = val << shift;
+	return TRUE;
+}
+
+// fuse changes the current directory once daemonized
+static char* gfalfs_absolute_path(const char* path){
+	if(g_path_is_absolute(path))
+		return g_strdup(path);
+	char* cwd = g_get_current_dir();
+	char* res = g_build_filename(cwd, path, NULL);
+	g_free(cwd);
+	return res;
+}
+
+static gboolean gfalfs_parse_size_option(const char* key, const char* value, guint64* res){
+	if(gfalfs_parse_size(value, res) == FALSE){
+		g_printerr("Invalid value for option %s : %s \n", key, (value)?value:"");
+		exit(1);
+	}
+	return TRUE;
+}
+
+
+/**
+ * parse one "key[=value]" element of the -o option list
+ * return TRUE if the option is handled by gfalFS, FALSE if it has to be passed to fuse
+ * */
+gboolean gfalfs_parse_option(const char* key, const char* value){
+	if(strcmp(key, "page_cache") == 0){
+		gfalfs_set_page_cache_mode(TRUE);
+		return TRUE;
+	}
+	if(strcmp(key, "md_cache") == 0){
+		md_cache_ttl_set = TRUE;
+		return gfalfs_parse_size_option(key, value, &md_cache_ttl);
+	}
+	if(strcmp(key, "link_cache") == 0){
+		link_cache_ttl_set = TRUE;
+		return gfalfs_parse_size_option(key, value, &link_cache_ttl);
+	}
+	if(strcmp(key, "md_cache_size") == 0)
+		return gfalfs_parse_size_option(key, value, &md_cache_size);
+	if(strcmp(key, "crawl") == 0){
+		crawl_mode = TRUE;
+		if(!md_cache_ttl_set)
+			md_cache_ttl = GFALFS_CRAWL_MD_CACHE_TTL;
+		return TRUE;
+	}
+	if(strcmp(key, "crawl_threads") == 0){
+		const gboolean res = gfalfs_parse_size_option(key, value, &crawl_threads);
+		crawl_threads = CLAMP(crawl_threads, 1, 256);
+		return res;
+	}
+	if(strcmp(key, "staging") == 0){
+		staging_mode = TRUE;
+		return TRUE;
+	}
+	if(strcmp(key, "staging_atomic") == 0){
+		staging_atomic = TRUE;
+		return TRUE;
+	}
+	if(strcmp(key, "spool_dir") == 0 && value != NULL){
+		g_free(spool_dir);
+		spool_dir = gfalfs_absolute_path(value);
+		return TRUE;
+	}
+	if(strcmp(key, "mounts") == 0 && value != NULL){
+		g_free(mounts_file);
+		mounts_file = gfalfs_absolute_path(value);
+		return TRUE;
+	}
+	if(strcmp(key, "trace") == 0 && value != NULL){
+		g_free(trace_file);
+		trace_file = gfalfs_absolute_path(value);
+		return TRUE;
+	}
+	if(strcmp(key, "trace_size") == 0)
+		return gfalfs_parse_size_option(key, value, &trace_size);
+	if(strcmp(key, "spool_max") == 0)
+		return gfalfs_parse_size_option(key, value, &spool_max);
+	if(strcmp(key, "spool_wait") == 0)
+		return gfalfs_parse_size_option(key, value, &spool_wait);
+	if(strcmp(key, "readahead") == 0){
+		readahead_mode = TRUE;
+		return TRUE;
+	}
+	if(strcmp(key, "readahead_blocks") == 0)
+		return gfalfs_parse_size_option(key, value, &readahead_blocks);
+	if(strcmp(key, "block_size") == 0){
+		gfalfs_parse_size_option(key, value, &block_size);
+		block_size = MAX(block_size, 4096);
+		return TRUE;
+	}
+	if(strcmp(key, "cache_size") == 0)
+		return gfalfs_parse_size_option(key, value, &cache_size);
+	if(strcmp(key, "buffer_mem") == 0){
+		gfalfs_parse_size_option(key, value, &buffer_mem);
+		buffer_mem = MAX(buffer_mem, 1 << 20);
+		return TRUE;
+	}
+	if(strcmp(key, "retries") == 0)
+		return gfalfs_parse_size_option(key, value, &retries);
+	if(strcmp(key, "retry_delay") == 0)
+		return gfalfs_parse_size_option(key, value, &retry_delay);
+	if(strcmp(key, "offline") == 0){
+		offline_mode = TRUE;
+		return TRUE;
+	}
+	if(strcmp(key, "offline_errors") == 0){
+		const gboolean res = gfalfs_parse_size_option(key, value, &offline_errors);
+		offline_errors = MAX(offline_errors, 1);
+		return res;
+	}
+	if(strcmp(key, "offline_timeout") == 0){
+		const gboolean res = gfalfs_parse_size_option(key, value, &offline_timeout);
+		offline_timeout = MAX(offline_timeout, 1);
+		return res;
+	}
+	if(strcmp(key, "offline_probe") == 0){
+		const gboolean res = gfalfs_parse_size_option(key, value, &offline_probe);
+		offline_probe = MAX(offline_probe, 1);
+		return res;
+	}
+	if(strcmp(key, "md_timeout") == 0)
+		return gfalfs_parse_size_option(key, value, &md_timeout);
+	if(strcmp(key, "ns_timeout") == 0)
+		return gfalfs_parse_size_option(key, value, &ns_timeout);
+	if(strcmp(key, "io_timeout") == 0)
+		return gfalfs_parse_size_option(key, value, &io_timeout);
+	if(strcmp(key, "op_threads") == 0){
+		const gboolean res = gfalfs_parse_size_option(key, value, &op_threads);
+		op_threads = CLAMP(op_threads, 1, 1024);
+		return res;
+	}
+	if(strcmp(key, "ns_safety") == 0){
+		if( (ns_safety = gfalfs_ns_safety_from_name(value)) == GFALFS_NS_INVALID){
+			g_printerr("Invalid value for option %s : %s, sync, batch or async expected \n", key, (value)?value:"");
+			exit(1);
+		}
+		return TRUE;
+	}
+	if(strcmp(key, "bulk_size") == 0){
+		const gboolean res = gfalfs_parse_size_option(key, value, &bulk_size);
+		bulk_size = CLAMP(bulk_size, 1, 4096);
+		return res;
+	}
+	if(strcmp(key, "bulk_threads") == 0){
+		const gboolean res = gfalfs_parse_size_option(key, value, &bulk_threads);
+		bulk_threads = CLAMP(bulk_threads, 1, 64);
+		return res;
+	}
+	if(strcmp(key, "checksum") == 0){
+		if( (checksum_type = gfalfs_checksum_type_from_name(value)) == GFALFS_CHECKSUM_NONE){
+			g_printerr("Invalid value for option %s : %s, adler32, crc32c or md5 expected \n", key, (value)?value:"");
+			exit(1);
+		}
+		return TRUE;
+	}
+	if(strcmp(key, "checksum_untyped") == 0){
+		if( (checksum_untyped = gfalfs_checksum_type_from_name(value)) == GFALFS_CHECKSUM_NONE){
+			g_printerr("Invalid value for option %s : %s, adler32, crc32c or md5 expected \n", key, (value)?value:"");
+			exit(1);
+		}
+		return TRUE;
+	}
+	if(strcmp(key, "blksize") == 0)
+		return gfalfs_parse_size_option(key, value, &blksize);
+	if(strcmp(key, "blksize_min") == 0)
+		return gfalfs_parse_size_option(key, value, &blksize_min);
+	if(strcmp(key, "blksize_max") == 0)
+		return gfalfs_parse_size_option(key, value, &blksize_max);
+	return FALSE;
+}
+
+
+/**
+ * check and adjust the options which depend on each other, once all of them are parsed
+ * print the error and return FALSE if they can not be used together
+ * */
+gboolean gfalfs_check_options(){
+	if(blksize_min > blksize_max){
+		g_printerr("Invalid values for options blksize_min and blksize_max : %lu is greater than %lu \n",
+					(unsigned long) blksize_min, (unsigned long) blksize_max);
+		return FALSE;
+	}
+	// one stream prefetches at most half of the block cache
+	readahead_blocks = MIN(readahead_blocks, MAX(cache_size / block_size / 2, 1));
+	if(offline_mode && !readahead_mode) // only the block cache keeps file content
+		g_printerr("Warning : option offline without readahead, the reads fail while the storage is offline \n");
+	return TRUE;
+}
+
 
 static inline void gfalfs_log_debug(const char* prefix, const char* format, va_list va){
 	if(gfalfs_get_debug_mode()){
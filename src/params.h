@@ -29,6 +29,81 @@ gboolean gfalfs_get_verbose_mode();
 void gfalfs_set_debug_mode(gboolean status);
 gboolean gfalfs_get_debug_mode();
 
+// kernel page cache mode : stable inode numbers and keep_cache on unchanged files
+void gfalfs_set_page_cache_mode(gboolean status);
+gboolean gfalfs_get_page_cache_mode();
+
+// st_blksize tuning, 0 means automatic
+guint64 gfalfs_get_blksize();
+guint64 gfalfs_get_blksize_min();
+guint64 gfalfs_get_blksize_max();
+
+// metadata cache, a ttl of 0 disables the cache lookups
+guint64 gfalfs_get_md_cache_ttl();
+guint64 gfalfs_get_link_cache_ttl(); // seconds, the metadata cache ttl unless given
+guint64 gfalfs_get_md_cache_size();
+
+// background crawler of the directory tree
+gboolean gfalfs_get_crawl_mode();
+guint64 gfalfs_get_crawl_threads();
+
+// mount table of the multi-mount mode, NULL if a single url is mounted
+const char* gfalfs_get_mounts_file();
+
+// binary trace of the operations, NULL if disabled
+const char* gfalfs_get_trace_file();
+guint64 gfalfs_get_trace_size();
+
+// local write staging with upload on close
+gboolean gfalfs_get_staging_mode();
+gboolean gfalfs_get_staging_atomic(); // upload to a temporary name renamed over the file
+const char* gfalfs_get_spool_dir();
+guint64 gfalfs_get_spool_max();
+guint64 gfalfs_get_spool_wait();
+
+// access pattern detection and block prefetching
+gboolean gfalfs_get_readahead_mode();
+guint64 gfalfs_get_readahead_blocks();
+guint64 gfalfs_get_block_size();
+guint64 gfalfs_get_cache_size();
+
+// memory cap of the I/O buffers in use
+guint64 gfalfs_get_buffer_mem();
+
+// reopen and retry of the transfers failed on a transient error, first delay in milli-seconds
+guint64 gfalfs_get_retries();
+guint64 gfalfs_get_retry_delay();
+
+// offline mode, the caches are served while the storage is unavailable
+gboolean gfalfs_get_offline_mode();
+guint64 gfalfs_get_offline_errors();
+guint64 gfalfs_get_offline_timeout(); // seconds
+guint64 gfalfs_get_offline_probe(); // seconds
+
+// deadlines of the metadata, namespace and data operations, in seconds, 0 for none
+guint64 gfalfs_get_md_timeout();
+guint64 gfalfs_get_ns_timeout();
+guint64 gfalfs_get_io_timeout();
+guint64 gfalfs_get_op_threads(); // workers of the calls with a deadline
+
+// bulk namespace operations, the safety mode is a gfalfs_ns_safety
+int gfalfs_get_ns_safety();
+guint64 gfalfs_get_bulk_size(); // unlinks per bulk call
+guint64 gfalfs_get_bulk_threads();
+
+// verification of the transfered content with the storage checksums, a gfalfs_checksum_type
+int gfalfs_get_checksum_type();
+int gfalfs_get_checksum_untyped(); // type of the checksums given by the storage without their type
+
+// parse a size with an optional k, M or G suffix, FALSE if invalid or out of range
+gboolean gfalfs_parse_size(const char* str, guint64* res);
+
+// parse a gfalFS specific mount option, return FALSE if the option belongs to fuse
+gboolean gfalfs_parse_option(const char* key, const char* value);
+
+// check and adjust the options depending on each other, print the error and return FALSE if they conflict
+gboolean gfalfs_check_options();
+
 
 void gfalfs_log (const gchar *log_domain,
 					 GLogLevelFlags log_level,
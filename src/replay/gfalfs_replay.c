@@ -0,0 +1,451 @@
+// Copyright @ Members of the EMI Collaboration, 2010.
+// See www.eu-emi.eu for details on the copyright holders.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * gfalfs_replay.c
+ * replay of a gfalFS trace against a mount point, with the original timing or
+ * as fast as possible, and comparison of the latencies with the trace
+ *
+ * the records of a path, and of the handles opened on it, are replayed in order
+ * by the same worker, the other paths concurrently. The names of the extended
+ * attributes are not traced, getxattr and setxattr are not replayed
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+
+#include <glib.h>
+
+#include "gfal_trace_format.h"
+
+#define GFALFS_REPLAY_DEFAULT_WORKERS 16
+
+typedef struct _gfalfs_replay_stats{
+	guint64 count;
+	guint64 errors;
+	guint64 mismatches; // success or failure differs from the trace
+	guint64 skipped;
+	guint64 trace_usec;
+	guint64 replay_usec;
+} gfalfs_replay_stats;
+
+typedef struct _gfalfs_replay_worker{
+	GThread* thread;
+	GAsyncQueue* queue;
+	GHashTable* files; // trace handle -> fd + 1
+	GHashTable* dirs; // trace handle -> DIR*
+	gfalfs_replay_stats stats[GFALFS_TRACE_OPS];
+	char* buffer;
+	size_t s_buffer;
+} gfalfs_replay_worker;
+
+static const char* mount_point = NULL;
+static GHashTable* paths = NULL; // path id -> path
+static gfalfs_trace_record end_record = { .op = GFALFS_TRACE_OPS };
+static gboolean verbose = FALSE;
+
+
+static void print_help(const char* progname){
+	g_printerr("Usage %s [-f] [-x speed] [-j workers] [-v] [trace_file] [mount_point]\n", progname);
+	g_printerr("\t [-f] : replay as fast as possible, without the original timing \n");
+	g_printerr("\t [-x] : speed factor of the original timing, 1 by default \n");
+	g_printerr("\t [-j] : concurrent workers, %d by default \n", GFALFS_REPLAY_DEFAULT_WORKERS);
+	g_printerr("\t [-v] : print each replayed operation \n");
+}
+
+static gboolean load_paths(const char* trace_file){
+	gchar* name = g_strconcat(trace_file, GFALFS_TRACE_PATHS_SUFFIX, NULL);
+	gchar* content = NULL;
+	GError* tmp_err = NULL;
+	if(g_file_get_contents(name, &content, NULL, &tmp_err) == FALSE){
+		g_printerr("Unable to read the path table %s : %s \n", name, tmp_err->message);
+		g_error_free(tmp_err);
+		g_free(name);
+		return FALSE;
+	}
+	paths = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+	gchar** lines = g_strsplit(content, "\n", -1);
+	gchar** p;
+	for(p = lines; *p != NULL; ++p){
+		char* end = NULL;
+		guint64 id = g_ascii_strtoull(*p, &end, 16);
+		if(end == *p || *end != ' ')
+			continue;
+		g_hash_table_insert(paths, g_memdup(&id, sizeof(guint64)), g_strcompress(end+1));
+	}
+	g_strfreev(lines);
+	g_free(content);
+	g_free(name);
+	return TRUE;
+}
+
+static gint compare_seq(gconstpointer a, gconstpointer b){
+	// the sequence numbers wrap around
+	const gint32 diff = (gint32) (((const gfalfs_trace_record*) a)->seq - ((const gfalfs_trace_record*) b)->seq);
+	return (diff > 0) - (diff < 0);
+}
+
+// valid records of the ring, by sequence number
+static GArray* load_trace(const char* trace_file){
+	struct stat st;
+	int fd = open(trace_file, O_RDONLY);
+	if(fd < 0 || fstat(fd, &st) != 0 || st.st_size < GFALFS_TRACE_HEADER_SIZE){
+		g_printerr("Unable to read the trace file %s : %s \n", trace_file, (fd < 0)?strerror(errno):"truncated file");
+		if(fd >= 0)
+			close(fd);
+		return NULL;
+	}
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED){
+		g_printerr("Unable to map the trace file %s : %s \n", trace_file, strerror(errno));
+		return NULL;
+	}
+	const gfalfs_trace_header* header = (const gfalfs_trace_header*) map;
+	if(memcmp(header->magic, GFALFS_TRACE_MAGIC, 8) != 0 || header->version != GFALFS_TRACE_VERSION
+		|| header->record_size != sizeof(gfalfs_trace_record)
+		|| GFALFS_TRACE_HEADER_SIZE + ((guint64) header->capacity) * sizeof(gfalfs_trace_record) > (guint64) st.st_size){
+		g_printerr("Invalid trace file %s \n", trace_file);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	const gfalfs_trace_record* records = (const gfalfs_trace_record*) (((const char*) map) + GFALFS_TRACE_HEADER_SIZE);
+	GArray* res = g_array_new(FALSE, FALSE, sizeof(gfalfs_trace_record));
+	guint32 i;
+	for(i = 0; i < header->capacity; ++i)
+		if(records[i].seq != 0 && records[i].op < GFALFS_TRACE_OPS)
+			g_array_append_val(res, records[i]);
+	munmap(map, st.st_size);
+	g_array_sort(res, compare_seq);
+	return res;
+}
+
+static const char* lookup_path(guint64 id){
+	return (const char*) g_hash_table_lookup(paths, &id);
+}
+
+static char* worker_buffer(gfalfs_replay_worker* w, size_t size){
+	if(size > w->s_buffer){
+		g_free(w->buffer);
+		w->buffer = g_malloc0(size);
+		w->s_buffer = size;
+	}
+	return w->buffer;
+}
+
+static int handle_fd(gfalfs_replay_worker* w, guint64 handle){
+	return GPOINTER_TO_INT(g_hash_table_lookup(w->files, &handle)) - 1;
+}
+
+static void set_handle_fd(gfalfs_replay_worker* w, guint64 handle, int fd){
+	const int old = handle_fd(w, handle);
+	if(old >= 0)
+		close(old);
+	g_hash_table_insert(w->files, g_memdup(&handle, sizeof(guint64)), GINT_TO_POINTER(fd + 1));
+}
+
+// descriptor of a handle, opened now if the open is not in the trace
+static int replay_fd(gfalfs_replay_worker* w, guint64 handle, const char* path, int flags){
+	int fd = handle_fd(w, handle);
+	if(fd < 0 && (fd = open(path, flags)) >= 0)
+		set_handle_fd(w, handle, fd);
+	return fd;
+}
+
+#define ERRNO_RES(r) (((r) < 0)?-(errno):(r))
+
+static void replay_time(guint64 t, struct timespec* ts){
+	if(t == GFALFS_TRACE_TIME_NOW || t == GFALFS_TRACE_TIME_OMIT){
+		ts->tv_sec = 0;
+		ts->tv_nsec = (t == GFALFS_TRACE_TIME_NOW)?UTIME_NOW:UTIME_OMIT;
+	}else{
+		ts->tv_sec = t / G_USEC_PER_SEC;
+		ts->tv_nsec = (t % G_USEC_PER_SEC) * 1000;
+	}
+}
+
+// replay a record on the full path, return the result like the traced operation
+// new_path is the full new path of a rename, or the target of a symlink as traced
+static int replay_record(gfalfs_replay_worker* w, const gfalfs_trace_record* r, const char* path, const char* new_path){
+	struct timespec times[2];
+	struct stat st;
+	int fd, ret;
+	DIR* d;
+	switch(r->op){
+		case GFALFS_TRACE_GETATTR:
+			return ERRNO_RES(lstat(path, &st));
+		case GFALFS_TRACE_FGETATTR:
+			fd = handle_fd(w, r->handle);
+			return ERRNO_RES((fd >= 0)?fstat(fd, &st):lstat(path, &st));
+		case GFALFS_TRACE_READLINK:
+			ret = readlink(path, worker_buffer(w, r->size + 1), r->size);
+			return (ret < 0)?-(errno):0;
+		case GFALFS_TRACE_OPENDIR:
+			if( (d = g_hash_table_lookup(w->dirs, &(r->handle))) != NULL) // handle reused by the trace
+				closedir(d);
+			g_hash_table_remove(w->dirs, &(r->handle));
+			if( (d = opendir(path)) == NULL)
+				return -(errno);
+			g_hash_table_insert(w->dirs, g_memdup(&(r->handle), sizeof(guint64)), d);
+			return 0;
+		case GFALFS_TRACE_READDIR:
+			if( (d = g_hash_table_lookup(w->dirs, &(r->handle))) == NULL)
+				return -(EBADF);
+			if(r->offset == 0)
+				rewinddir(d);
+			errno = 0;
+			while(readdir(d) != NULL);
+			return -(errno);
+		case GFALFS_TRACE_RELEASEDIR:
+			if( (d = g_hash_table_lookup(w->dirs, &(r->handle))) == NULL)
+				return -(EBADF);
+			g_hash_table_remove(w->dirs, &(r->handle));
+			return ERRNO_RES(closedir(d));
+		case GFALFS_TRACE_OPEN:
+		case GFALFS_TRACE_CREATE:
+			fd = (r->op == GFALFS_TRACE_CREATE)?open(path, ((int) r->arg) | O_CREAT, (mode_t) r->size)
+											:open(path, (int) r->arg, 0644);
+			if(fd < 0)
+				return -(errno);
+			set_handle_fd(w, r->handle, fd);
+			return 0;
+		case GFALFS_TRACE_READ:
+			if( (fd = replay_fd(w, r->handle, path, O_RDONLY)) < 0)
+				return -(errno);
+			return ERRNO_RES(pread(fd, worker_buffer(w, r->size), r->size, r->offset));
+		case GFALFS_TRACE_WRITE:
+			if( (fd = replay_fd(w, r->handle, path, O_WRONLY)) < 0)
+				return -(errno);
+			memset(worker_buffer(w, r->size), 0, r->size);
+			return ERRNO_RES(pwrite(fd, w->buffer, r->size, r->offset));
+		case GFALFS_TRACE_FLUSH:
+			return 0;
+		case GFALFS_TRACE_RELEASE:
+			if( (fd = handle_fd(w, r->handle)) < 0)
+				return -(EBADF);
+			g_hash_table_remove(w->files, &(r->handle));
+			return ERRNO_RES(close(fd));
+		case GFALFS_TRACE_ACCESS:
+			return ERRNO_RES(access(path, (int) r->arg));
+		case GFALFS_TRACE_MKDIR:
+			return ERRNO_RES(mkdir(path, (mode_t) r->arg));
+		case GFALFS_TRACE_RMDIR:
+			return ERRNO_RES(rmdir(path));
+		case GFALFS_TRACE_UNLINK:
+			return ERRNO_RES(unlink(path));
+		case GFALFS_TRACE_RENAME:
+			if(new_path == NULL)
+				return -(ENOENT);
+			return ERRNO_RES(rename(path, new_path));
+		case GFALFS_TRACE_TRUNCATE:
+			return ERRNO_RES(truncate(path, r->size));
+		case GFALFS_TRACE_FTRUNCATE:
+			fd = handle_fd(w, r->handle);
+			return ERRNO_RES((fd >= 0)?ftruncate(fd, r->size):truncate(path, r->size));
+		case GFALFS_TRACE_SYMLINK:
+			if(new_path == NULL)
+				return -(ENOENT);
+			return ERRNO_RES(symlink(new_path, path));
+		case GFALFS_TRACE_CHMOD:
+			return ERRNO_RES(chmod(path, (mode_t) r->arg));
+		case GFALFS_TRACE_CHOWN:
+			return ERRNO_RES(lchown(path, (uid_t) (r->arg >> 32), (gid_t) (r->arg & 0xffffffff)));
+		case GFALFS_TRACE_UTIMENS:
+			replay_time(r->offset, &times[0]);
+			replay_time(r->size, &times[1]);
+			return ERRNO_RES(utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW));
+		case GFALFS_TRACE_LISTXATTR:
+			ret = llistxattr(path, worker_buffer(w, r->size + 1), r->size);
+			return ERRNO_RES(ret);
+		default:
+			return 0;
+	}
+}
+
+static gpointer worker_run(gpointer data){
+	gfalfs_replay_worker* w = (gfalfs_replay_worker*) data;
+	const gfalfs_trace_record* r;
+	char path[4096];
+	char new_path[4096];
+	while( (r = g_async_queue_pop(w->queue)) != &end_record){
+		gfalfs_replay_stats* stats = &(w->stats[r->op]);
+		const char* local_path = lookup_path(r->path_id);
+		const char* local_new_path = (r->op == GFALFS_TRACE_RENAME || r->op == GFALFS_TRACE_SYMLINK)?lookup_path(r->arg):NULL;
+		if(local_path == NULL || r->op == GFALFS_TRACE_GETXATTR || r->op == GFALFS_TRACE_SETXATTR){
+			stats->skipped++;
+			continue;
+		}
+		g_snprintf(path, 4096, "%s%s", mount_point, local_path);
+		if(local_new_path && r->op == GFALFS_TRACE_SYMLINK) // the target is kept as given
+			g_strlcpy(new_path, local_new_path, 4096);
+		else if(local_new_path)
+			g_snprintf(new_path, 4096, "%s%s", mount_point, local_new_path);
+		const gint64 start = g_get_monotonic_time();
+		const int ret = replay_record(w, r, path, (local_new_path)?new_path:NULL);
+		const gint64 usec = g_get_monotonic_time() - start;
+		stats->count++;
+		stats->trace_usec += r->latency;
+		stats->replay_usec += usec;
+		if(ret < 0)
+			stats->errors++;
+		if((ret < 0) != (r->result < 0))
+			stats->mismatches++;
+		if(verbose)
+			printf("%u %s %s offset=%lu size=%lu result=%d trace_result=%d usec=%ld trace_usec=%u\n",
+					r->seq - 1, gfalfs_trace_op_name(r->op), local_path, (unsigned long) r->offset,
+					(unsigned long) r->size, ret, r->result, (long) usec, r->latency);
+	}
+	return NULL;
+}
+
+static gboolean is_handle_open(guint16 op){
+	return op == GFALFS_TRACE_OPEN || op == GFALFS_TRACE_CREATE || op == GFALFS_TRACE_OPENDIR;
+}
+
+static gboolean is_handle_release(guint16 op){
+	return op == GFALFS_TRACE_RELEASE || op == GFALFS_TRACE_RELEASEDIR;
+}
+
+// worker of a record : the one of its path, the one of the path of the open for a handle
+static guint dispatch_key(GHashTable* handle_paths, const gfalfs_trace_record* r){
+	guint64 key = r->path_id;
+	if(r->handle != 0){
+		if(is_handle_open(r->op)){
+			g_hash_table_insert(handle_paths, g_memdup(&(r->handle), sizeof(guint64)), g_memdup(&(r->path_id), sizeof(guint64)));
+		}else{
+			const guint64* opened = g_hash_table_lookup(handle_paths, &(r->handle));
+			if(opened != NULL)
+				key = *opened;
+			if(is_handle_release(r->op))
+				g_hash_table_remove(handle_paths, &(r->handle));
+		}
+	}
+	return (guint) (key ^ (key >> 32));
+}
+
+static void close_fd(gpointer key, gpointer value, gpointer user_data){
+	close(GPOINTER_TO_INT(value) - 1);
+}
+
+static void close_dir(gpointer key, gpointer value, gpointer user_data){
+	closedir((DIR*) value);
+}
+
+static void print_report(gfalfs_replay_worker* workers, int n_workers, guint records, gint64 elapsed){
+	int op, i;
+	printf("%u records replayed in %.3f s\n", records, elapsed / 1000000.0);
+	printf("%-12s %10s %10s %10s %10s %14s %14s\n", "operation", "count", "errors", "mismatches", "skipped",
+				"trace_avg_us", "replay_avg_us");
+	for(op = 0; op < GFALFS_TRACE_OPS; ++op){
+		gfalfs_replay_stats total = { 0 };
+		for(i = 0; i < n_workers; ++i){
+			total.count += workers[i].stats[op].count;
+			total.errors += workers[i].stats[op].errors;
+			total.mismatches += workers[i].stats[op].mismatches;
+			total.skipped += workers[i].stats[op].skipped;
+			total.trace_usec += workers[i].stats[op].trace_usec;
+			total.replay_usec += workers[i].stats[op].replay_usec;
+		}
+		if(total.count == 0 && total.skipped == 0)
+			continue;
+		printf("%-12s %10lu %10lu %10lu %10lu %14lu %14lu\n", gfalfs_trace_op_name(op),
+					(unsigned long) total.count, (unsigned long) total.errors, (unsigned long) total.mismatches,
+					(unsigned long) total.skipped,
+					(unsigned long) ((total.count)?total.trace_usec / total.count:0),
+					(unsigned long) ((total.count)?total.replay_usec / total.count:0));
+	}
+}
+
+int main(int argc, char** argv){
+	gboolean fast = FALSE;
+	double speed = 1.0;
+	int n_workers = GFALFS_REPLAY_DEFAULT_WORKERS;
+	int c, i;
+	while( (c = getopt(argc, argv, "fx:j:vh")) != -1){
+		switch(c){
+			case 'f':
+				fast = TRUE;
+				break;
+			case 'x':
+				speed = g_ascii_strtod(optarg, NULL);
+				break;
+			case 'j':
+				n_workers = atoi(optarg);
+				break;
+			case 'v':
+				verbose = TRUE;
+				break;
+			default:
+				print_help(argv[0]);
+				exit(1);
+		}
+	}
+	if(optind + 2 != argc || speed <= 0 || n_workers < 1){
+		print_help(argv[0]);
+		exit(1);
+	}
+	if (!g_thread_supported())
+		g_thread_init(NULL);
+	const char* trace_file = argv[optind];
+	mount_point = argv[optind+1];
+	GArray* records = load_trace(trace_file);
+	if(records == NULL || load_paths(trace_file) == FALSE)
+		exit(1);
+
+	gfalfs_replay_worker* workers = g_new0(gfalfs_replay_worker, n_workers);
+	for(i = 0; i < n_workers; ++i){
+		workers[i].queue = g_async_queue_new();
+		workers[i].files = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+		workers[i].dirs = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+		workers[i].thread = g_thread_create(worker_run, &(workers[i]), TRUE, NULL);
+	}
+
+	GHashTable* handle_paths = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free); // handle -> path id of its open
+	const gint64 origin = g_get_monotonic_time();
+	// the records are in sequence order, a call may start before the previous sequence number
+	guint64 first = G_MAXUINT64;
+	guint n;
+	for(n = 0; n < records->len; ++n)
+		first = MIN(first, g_array_index(records, gfalfs_trace_record, n).start);
+	for(n = 0; n < records->len; ++n){
+		const gfalfs_trace_record* r = &g_array_index(records, gfalfs_trace_record, n);
+		if(fast == FALSE){
+			const gint64 due = origin + (gint64) (((gint64) r->start - (gint64) first) / speed);
+			const gint64 now = g_get_monotonic_time();
+			if(due > now)
+				g_usleep(due - now);
+		}
+		g_async_queue_push(workers[dispatch_key(handle_paths, r) % n_workers].queue, (gpointer) r);
+	}
+	g_hash_table_destroy(handle_paths);
+	for(i = 0; i < n_workers; ++i)
+		g_async_queue_push(workers[i].queue, &end_record);
+	for(i = 0; i < n_workers; ++i){
+		g_thread_join(workers[i].thread);
+		g_hash_table_foreach(workers[i].files, close_fd, NULL);
+		g_hash_table_foreach(workers[i].dirs, close_dir, NULL);
+	}
+	print_report(workers, n_workers, records->len, g_get_monotonic_time() - origin);
+	return 0;
+}